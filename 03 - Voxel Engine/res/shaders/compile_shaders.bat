@@ -1,6 +1,12 @@
-glslc main.vert -o main_vert.spv
-glslc main.frag -o main_frag.spv
-glslc wireframe.vert -o wireframe_vert.spv
-glslc wireframe.frag -o wireframe_frag.spv
-glslc selection.vert -o selection_vert.spv
-glslc selection.frag -o selection_frag.spv
\ No newline at end of file
+glslangValidator -V main.vert -o main_vert.spv
+glslangValidator -V main.frag -o main_frag.spv
+glslangValidator -V wireframe.vert -o wireframe_vert.spv
+glslangValidator -V wireframe.frag -o wireframe_frag.spv
+glslangValidator -V selection.vert -o selection_vert.spv
+glslangValidator -V selection.frag -o selection_frag.spv
+spirv-val --target-env vulkan1.0 main_vert.spv
+spirv-val --target-env vulkan1.0 main_frag.spv
+spirv-val --target-env vulkan1.0 wireframe_vert.spv
+spirv-val --target-env vulkan1.0 wireframe_frag.spv
+spirv-val --target-env vulkan1.0 selection_vert.spv
+spirv-val --target-env vulkan1.0 selection_frag.spv
\ No newline at end of file
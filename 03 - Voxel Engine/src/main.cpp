@@ -27,8 +27,8 @@
 #define GLFW_DEFAULT_HEIGHT 720
 
 #define SHADER_MODULES_COUNT 6
-#define COMMAND_POOLS_COUNT 1
-#define VULKAN_QUEUES_COUNT 2
+#define COMMAND_POOLS_COUNT 2
+#define VULKAN_QUEUES_COUNT 3
 #define RENDER_PASS_COUNT 2
 #define PIPELINES_COUNT 4
 #define RENDER_TARGETS_COUNT 3
@@ -60,6 +60,10 @@ static VkFramebuffer target_framebuffers[FRAMEBUFFERS_COUNT];
 
 #define QUEUE_GRAPHICS 0
 #define QUEUE_PRESENT 1
+#define QUEUE_TRANSFER 2
+
+#define COMMAND_POOL_GRAPHICS 0
+#define COMMAND_POOL_TRANSFER 1
 
 #define RENDER_TARGET_DEPTH_BUFFER 0
 #define RENDER_TARGET_SELECTION_BUFFER 1
@@ -211,11 +215,16 @@ void unload_graphics_pipelines()
 		delete pipelines[i];
 }
 
-bool load_command_pools()
+//Falls back on the graphics queue family if there's no dedicated transfer one.
+uint32_t get_transfer_queue_family(const queue_family& qf)
 {
-	queue_family qf = find_physical_device_queue_families(get_selected_physical_device());
-		
-	if(!create_command_pool(&command_pools[0], qf.queue_index_graphics.value())) return false;
+	return qf.queue_index_transfer.value_or(qf.queue_index_graphics.value());
+}
+
+bool load_command_pools(const queue_family& qf)
+{
+	if(!create_command_pool(&command_pools[COMMAND_POOL_GRAPHICS], qf.queue_index_graphics.value())) return false;
+	if(!create_command_pool(&command_pools[COMMAND_POOL_TRANSFER], get_transfer_queue_family(qf))) return false;
 	
 	return true;
 }
@@ -232,12 +241,11 @@ void unload_command_pools()
 #endif
 }
 
-void get_vulkan_queues()
+void get_vulkan_queues(const queue_family& qf)
 {
-	queue_family qf = find_physical_device_queue_families(get_selected_physical_device());
-		
 	vkGetDeviceQueue(get_device(), qf.queue_index_graphics.value(), 0, &queues[QUEUE_GRAPHICS]);
 	vkGetDeviceQueue(get_device(), qf.queue_index_present.value(), 0, &queues[QUEUE_PRESENT]);
+	vkGetDeviceQueue(get_device(), get_transfer_queue_family(qf), 0, &queues[QUEUE_TRANSFER]);
 }
 
 bool load_render_targets(swapchain* sc)
@@ -322,11 +330,12 @@ int main()
 	if(!init_vulkan_application(window)) return 1;
 	
 	INFO_LOG("Loading Vulkan command pools and queues.");
-	if(!load_command_pools()) return 1;
-	get_vulkan_queues();
+	queue_family qf = find_physical_device_queue_families(get_selected_physical_device());
+	if(!load_command_pools(qf)) return 1;
+	get_vulkan_queues(qf);
 	
 	INFO_LOG("Initializing memory allocator.");
-	alloc::init(queues[QUEUE_GRAPHICS], command_pools[0]);
+	alloc::init(queues[QUEUE_GRAPHICS], command_pools[COMMAND_POOL_GRAPHICS], qf.queue_index_graphics.value(), queues[QUEUE_TRANSFER], command_pools[COMMAND_POOL_TRANSFER], get_transfer_queue_family(qf));
 
 	INFO_LOG("Initializing Vulkan swapchain and render targets.");
 	swapchain* sc = new swapchain(window);
@@ -370,7 +379,7 @@ int main()
 	INFO_LOG("Creating command buffers.");
 	command_buffer** cmd_buffer = new command_buffer*[num_images];
 	for(size_t i = 0; i < num_images; i++)
-		cmd_buffer[i] = new command_buffer(command_pools[0]);
+		cmd_buffer[i] = new command_buffer(command_pools[COMMAND_POOL_GRAPHICS]);
 
 	INFO_LOG("Creating 3D camera.");
 	camera = new camera3d(math::vec3(32, 40, 32));
@@ -245,7 +245,8 @@ queue_family find_physical_device_queue_families(VkPhysicalDevice device)
 		}
 		else if(queue_families[i].queueFlags & VK_QUEUE_TRANSFER_BIT)
 		{
-			qf.queue_index_transfer = i;
+			//Families that can only transfer are the copy engines, they're preferred over async compute ones.
+			if(!qf.queue_index_transfer.has_value() || !(queue_families[i].queueFlags & VK_QUEUE_COMPUTE_BIT)) qf.queue_index_transfer = i;
 		}
 		
 		VkBool32 supports_presentation;
@@ -378,6 +379,7 @@ bool init_vulkan_device()
 	queue_family qf = find_physical_device_queue_families(vk_physical_device);
 	
 	std::set<uint32_t> queue_indices = {qf.queue_index_graphics.value(), qf.queue_index_present.value()};
+	if(qf.queue_index_transfer.has_value()) queue_indices.insert(qf.queue_index_transfer.value());
 	VkDeviceQueueCreateInfo* info_queues = new VkDeviceQueueCreateInfo[queue_indices.size()];
 
 	float queue_priority = 1.f;
@@ -0,0 +1,117 @@
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../utils/alloc_trace.h"
+#include "../utils/memory_backend.h"
+#include "../utils/page_allocator.h"
+
+//Same as in alloc.cpp, so traces recorded in game are placed the same way.
+#define PAGE_SIZE (128ull << 20)
+#define BUDDY_PAGE_FACTOR 26
+
+#define SESSION_TRACE "alloc_replay_trace.txt"
+#define SESSION_ALLOCATIONS 50000
+#define SESSION_LIVE_ALLOCATIONS 300
+
+//Records a made up session, meshes of 1 KB to 1 MB with a few hundred alive at once, through an unbacked host backend.
+static bool record_session(const std::string& path, memory_stats* stats)
+{
+	host_memory_backend backend(false);
+	page_allocator allocator(&backend, PAGE_SIZE, BUDDY_PAGE_FACTOR);
+	
+	if(!alloc_trace::start_recording(path)) return false;
+	
+	std::mt19937 random(5);
+	std::vector<page_allocation> live;
+	
+	for(uint32_t i = 0; i < SESSION_ALLOCATIONS; i++)
+	{
+		uint32_t memory_type = i % 3 ? 7 : 2;
+		uint64_t size = 1024 + random() % (1 << 20);
+		
+		page_allocation allocation;
+		if(allocator.allocate(memory_type, size, 256, false, &allocation))
+		{
+			alloc_trace::record_allocation(memory_type, size, 256, false, allocation);
+			live.push_back(allocation);
+		}
+		
+		if(live.size() > SESSION_LIVE_ALLOCATIONS)
+		{
+			size_t victim = random() % live.size();
+			alloc_trace::record_free(live[victim]);
+			allocator.free(live[victim]);
+			live[victim] = live.back();
+			live.pop_back();
+		}
+	}
+	
+	alloc_trace::end_recording();
+	allocator.get_total_stats(stats);
+	return true;
+}
+
+//Returns false if the trace couldn't be read, any allocation failed, or pages are left over once everything was given back.
+static bool replay(const std::string& path, bool backed, memory_stats* stats)
+{
+	host_memory_backend backend(backed);
+	page_allocator allocator(&backend, PAGE_SIZE, BUDDY_PAGE_FACTOR);
+	
+	alloc_trace_result result;
+	if(!alloc_trace::replay(path, &allocator, &result)) return false;
+	
+	std::cout << "[UTILS|INF] Replayed " << result.allocation_count << " allocations and " << result.free_count << " frees into " << (backed ? "backed" : "unbacked")
+		<< " host memory in " << result.elapsed_us << " us, " << allocator.get_page_count() << " pages." << std::endl;
+	
+	allocator.get_total_stats(stats);
+	print_memory_stats("Replay", *stats);
+	
+	allocator.free_pages();
+	
+	if(result.failed_count > 0)
+	{
+		std::cerr << "[UTILS|ERR] " << result.failed_count << " allocations failed during the replay." << std::endl;
+		return false;
+	}
+	
+	if(backend.get_allocated_size() != 0)
+	{
+		std::cerr << "[UTILS|ERR] " << backend.get_allocated_size() << " bytes of pages weren't given back." << std::endl;
+		return false;
+	}
+	
+	return true;
+}
+
+static bool is_same_placement(const memory_stats& a, const memory_stats& b)
+{
+	return a.capacity == b.capacity && a.allocated_size == b.allocated_size && a.free_size == b.free_size && a.largest_free_block == b.largest_free_block
+		&& a.allocation_count == b.allocation_count && a.free_block_count == b.free_block_count;
+}
+
+//Usage: alloc_replay [trace]
+//Replays a trace recorded with ALLOC_RECORD_TRACE. Without one, records a session of its own and checks that replaying it places everything the same way.
+int main(int argc, char** argv)
+{
+	memory_stats stats;
+	
+	if(argc > 1) return replay(argv[1], true, &stats) ? 0 : 1;
+	
+	memory_stats recorded;
+	if(!record_session(SESSION_TRACE, &recorded)) return 1;
+	
+	for(int backed = 0; backed < 2; backed++)
+	{
+		if(!replay(SESSION_TRACE, backed, &stats)) return 1;
+		
+		if(!is_same_placement(recorded, stats))
+		{
+			std::cerr << "[UTILS|ERR] Replay placed allocations differently from the recorded session." << std::endl;
+			return 1;
+		}
+	}
+	
+	return 0;
+}
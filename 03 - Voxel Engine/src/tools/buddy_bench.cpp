@@ -0,0 +1,268 @@
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../utils/buddy.h"
+#include "../utils/tlsf.h"
+
+#define POOL_FACTOR 28
+#define POOL_SIZE (1ull << POOL_FACTOR)
+#define STREAM_STEPS 100000
+#define STREAM_LIVE_ALLOCATIONS 400
+#define STREAM_ALIGNMENT 256
+
+#define CHECK_POOL_FACTOR 20
+#define CHECK_STEPS 200000
+#define CHECK_LIVE_ALLOCATIONS 40
+
+//Allocates and frees at random in a small pool, checking that every block is aligned to its size, that none overlap, and that everything merges back.
+static bool check_buddy()
+{
+	buddy_allocator allocator(CHECK_POOL_FACTOR);
+	std::mt19937 random(3);
+	
+	std::vector<uint64_t> live;
+	std::map<uint64_t, uint64_t> used;
+	
+	for(uint32_t i = 0; i < CHECK_STEPS; i++)
+	{
+		if(live.size() < CHECK_LIVE_ALLOCATIONS && random() % 2)
+		{
+			uint64_t size = 1 + random() % 60000;
+			uint64_t offset;
+			if(!allocator.allocate(size, STREAM_ALIGNMENT, &offset)) continue;
+			
+			uint64_t block_size = (uint64_t) 1 << BUDDY_MIN_FACTOR;
+			while(block_size < size) block_size <<= 1;
+			
+			if(offset % block_size != 0)
+			{
+				std::cerr << "[UTILS|ERR] Block at " << offset << " isn't aligned to its size, " << block_size << "." << std::endl;
+				return false;
+			}
+			
+			std::map<uint64_t, uint64_t>::iterator next = used.lower_bound(offset);
+			bool overlaps_next = next != used.end() && next->first < offset + block_size;
+			bool overlaps_prev = next != used.begin() && std::prev(next)->first + std::prev(next)->second > offset;
+			if(overlaps_next || overlaps_prev)
+			{
+				std::cerr << "[UTILS|ERR] Block at " << offset << " overlaps another one." << std::endl;
+				return false;
+			}
+			
+			used[offset] = block_size;
+			live.push_back(offset);
+		}
+		else if(!live.empty())
+		{
+			size_t victim = random() % live.size();
+			used.erase(live[victim]);
+			allocator.free(live[victim]);
+			live[victim] = live.back();
+			live.pop_back();
+		}
+	}
+	
+	for(uint64_t offset : live)
+		allocator.free(offset);
+	
+	memory_stats stats;
+	allocator.get_stats(&stats);
+	if(stats.allocation_count != 0 || stats.largest_free_block != allocator.get_size())
+	{
+		std::cerr << "[UTILS|ERR] The pool didn't merge back into one free block." << std::endl;
+		return false;
+	}
+	
+	return true;
+}
+
+//Sizes of sector meshes: mostly 64 KB to 1 MB, spread out around a few typical sizes.
+static std::vector<uint64_t> make_stream(std::vector<uint32_t>* victims)
+{
+	std::mt19937 random(11);
+	std::normal_distribution<double> spread(0, 0.3);
+	
+	std::vector<uint64_t> sizes(STREAM_STEPS + STREAM_LIVE_ALLOCATIONS);
+	for(uint64_t& size : sizes)
+	{
+		uint32_t kind = random() % 10;
+		double base = kind < 1 ? 4096 : kind < 5 ? 65536 : kind < 8 ? 262144 : 1048576;
+		size = (uint64_t) (base * std::exp(spread(random))) & ~(uint64_t) 3;
+	}
+	
+	victims->resize(sizes.size());
+	for(uint32_t& victim : *victims)
+		victim = random();
+	
+	return sizes;
+}
+
+static void print_run(const std::string& name, const memory_stats& stats, std::chrono::steady_clock::time_point start, uint32_t failed_count)
+{
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	
+	print_memory_stats(name, stats);
+	std::cout << "[UTILS|INF]   " << ms << " ms, " << failed_count << " allocations failed." << std::endl;
+}
+
+//Frees are taken out of the middle of the live allocations, so the pool sees the same holes with every allocator.
+static void run_tlsf(const std::vector<uint64_t>& sizes, const std::vector<uint32_t>& victims)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	
+	tlsf_allocator allocator;
+	allocator.add_region(0, POOL_SIZE);
+	
+	std::deque<uint32_t> live;
+	uint32_t failed_count = 0;
+	
+	for(size_t i = 0; i < sizes.size(); i++)
+	{
+		tlsf_allocation a;
+		if(allocator.allocate(sizes[i], STREAM_ALIGNMENT, &a)) live.push_back(a.block);
+		else failed_count++;
+		
+		if(live.size() > STREAM_LIVE_ALLOCATIONS)
+		{
+			size_t victim = victims[i] % live.size();
+			allocator.free(live[victim]);
+			live.erase(live.begin() + victim);
+		}
+	}
+	
+	memory_stats stats;
+	allocator.get_stats(&stats);
+	print_run("TLSF", stats, start, failed_count);
+}
+
+static void run_buddy(const std::vector<uint64_t>& sizes, const std::vector<uint32_t>& victims)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	
+	buddy_allocator allocator(POOL_FACTOR);
+	
+	std::deque<uint64_t> live;
+	uint32_t failed_count = 0;
+	
+	for(size_t i = 0; i < sizes.size(); i++)
+	{
+		uint64_t offset;
+		if(allocator.allocate(sizes[i], STREAM_ALIGNMENT, &offset)) live.push_back(offset);
+		else failed_count++;
+		
+		if(live.size() > STREAM_LIVE_ALLOCATIONS)
+		{
+			size_t victim = victims[i] % live.size();
+			allocator.free(live[victim]);
+			live.erase(live.begin() + victim);
+		}
+	}
+	
+	memory_stats stats;
+	allocator.get_stats(&stats);
+	print_run("Buddy", stats, start, failed_count);
+}
+
+//The first fit free list alloc.cpp used before TLSF, sorted by offset and merged on every free.
+static void run_first_fit(const std::vector<uint64_t>& sizes, const std::vector<uint32_t>& victims)
+{
+	struct free_node
+	{
+		uint64_t offset, size;
+	};
+	
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	
+	std::vector<free_node> free_list = {{0, POOL_SIZE}};
+	
+	std::deque<free_node> live;
+	uint32_t failed_count = 0;
+	uint64_t requested_size = 0;
+	
+	for(size_t i = 0; i < sizes.size(); i++)
+	{
+		bool allocated = false;
+		for(size_t j = 0; j < free_list.size() && !allocated; j++)
+		{
+			uint64_t offset = (free_list[j].offset + STREAM_ALIGNMENT - 1) / STREAM_ALIGNMENT * STREAM_ALIGNMENT;
+			uint64_t end = free_list[j].offset + free_list[j].size;
+			if(offset + sizes[i] > end) continue;
+			
+			if(offset == free_list[j].offset)
+			{
+				free_list[j].offset += sizes[i];
+				free_list[j].size -= sizes[i];
+				if(free_list[j].size == 0) free_list.erase(free_list.begin() + j);
+			}
+			else
+			{
+				free_list[j].size = offset - free_list[j].offset;
+				if(offset + sizes[i] < end) free_list.insert(free_list.begin() + j + 1, {offset + sizes[i], end - offset - sizes[i]});
+			}
+			
+			live.push_back({offset, sizes[i]});
+			requested_size += sizes[i];
+			allocated = true;
+		}
+		
+		if(!allocated) failed_count++;
+		
+		if(live.size() > STREAM_LIVE_ALLOCATIONS)
+		{
+			size_t victim = victims[i] % live.size();
+			free_node freed = live[victim];
+			live.erase(live.begin() + victim);
+			requested_size -= freed.size;
+			
+			size_t position = 0;
+			while(position < free_list.size() && free_list[position].offset <= freed.offset) position++;
+			free_list.insert(free_list.begin() + position, freed);
+			
+			for(size_t j = 1; j < free_list.size(); j++)
+			{
+				if(free_list[j - 1].offset + free_list[j - 1].size != free_list[j].offset) continue;
+				
+				free_list[j - 1].size += free_list[j].size;
+				free_list.erase(free_list.begin() + j);
+				j--;
+			}
+		}
+	}
+	
+	memory_stats stats = {};
+	stats.capacity = POOL_SIZE;
+	stats.requested_size = requested_size;
+	stats.allocated_size = requested_size;
+	stats.allocation_count = live.size();
+	stats.free_block_count = free_list.size();
+	
+	for(const free_node& node : free_list)
+	{
+		stats.free_size += node.size;
+		if(node.size > stats.largest_free_block) stats.largest_free_block = node.size;
+	}
+	
+	print_run("First fit", stats, start, failed_count);
+}
+
+//Usage: buddy_bench
+//Checks buddy_allocator, then streams 100k mesh sized allocations through a 256 MB pool with TLSF, buddy and the old first fit free list, and prints how full and fragmented each ends up.
+int main()
+{
+	if(!check_buddy()) return 1;
+	
+	std::vector<uint32_t> victims;
+	std::vector<uint64_t> sizes = make_stream(&victims);
+	
+	run_tlsf(sizes, victims);
+	run_buddy(sizes, victims);
+	run_first_fit(sizes, victims);
+	
+	return 0;
+}
@@ -0,0 +1,188 @@
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../utils/mapped_file.h"
+
+#include "../voxel/region.h"
+
+//Same as in sector.h, which can't be included without Vulkan.
+#define SECTOR_SIZE 64
+#define SECTOR_VOLUME (SECTOR_SIZE * SECTOR_SIZE * SECTOR_SIZE)
+
+#define SAMPLE_DIRECTORY "region_bench_world/"
+#define SAMPLE_SECTORS 8
+#define BENCH_ROUNDS 3
+
+struct sector_position
+{
+	int64_t x, y, z;
+};
+
+//Rolling hills of a few materials, about as compressible as generated terrain.
+static void make_sample_voxels(const sector_position& p, uint32_t* voxels)
+{
+	for(uint32_t x = 0; x < SECTOR_SIZE; x++)
+	{
+		for(uint32_t z = 0; z < SECTOR_SIZE; z++)
+		{
+			int64_t wx = p.x * SECTOR_SIZE + x;
+			int64_t wz = p.z * SECTOR_SIZE + z;
+			int64_t height = 8 + (wx * 7 + wz * 13) % 48 / 2 + (wx / 5 + wz / 3) % 8;
+			
+			for(uint32_t y = 0; y < SECTOR_SIZE; y++)
+			{
+				int64_t wy = p.y * SECTOR_SIZE + y;
+				voxels[(x * SECTOR_SIZE + y) * SECTOR_SIZE + z] = wy > height ? 0 : wy == height ? 1 : wy > height - 4 ? 2 : 3;
+			}
+		}
+	}
+}
+
+//Saves a small world of sample sectors, and checks that every one of them reads back as it was written.
+static bool write_sample_world(const std::string& directory, std::vector<sector_position>* sectors)
+{
+	std::filesystem::remove_all(directory);
+	if(!region::init(directory)) return false;
+	
+	for(int64_t x = -SAMPLE_SECTORS / 2; x < SAMPLE_SECTORS / 2; x++)
+	{
+		for(int64_t y = -1; y <= 1; y++)
+		{
+			for(int64_t z = -SAMPLE_SECTORS / 2; z < SAMPLE_SECTORS / 2; z++)
+			{
+				std::vector<uint32_t> voxels(SECTOR_VOLUME);
+				make_sample_voxels({x, y, z}, voxels.data());
+				region::queue_save_sector(x, y, z, std::move(voxels));
+				sectors->push_back({x, y, z});
+			}
+		}
+	}
+	
+	bool synced = region::sync();
+	region::deinit();
+	if(!synced) return false;
+	
+	if(!region::init(directory)) return false;
+	
+	std::vector<uint32_t> expected(SECTOR_VOLUME), voxels(SECTOR_VOLUME);
+	std::vector<uint32_t> edits;
+	bool matches = true;
+	
+	for(const sector_position& p : *sectors)
+	{
+		make_sample_voxels(p, expected.data());
+		if(region::load_sector(p.x, p.y, p.z, voxels.data(), voxels.size(), &edits) != REGION_LOAD_VOXELS || voxels != expected)
+		{
+			std::cerr << "[VOX|ERR] Sector (" << p.x << ", " << p.y << ", " << p.z << ") didn't read back as it was saved." << std::endl;
+			matches = false;
+			break;
+		}
+	}
+	
+	region::deinit();
+	return matches;
+}
+
+//Every sector of every region file in the directory that has been saved.
+static bool find_saved_sectors(const std::string& directory, std::vector<sector_position>* sectors)
+{
+	std::error_code ec;
+	std::filesystem::directory_iterator files(directory, ec);
+	if(ec)
+	{
+		std::cerr << "[VOX|ERR] Failed to list save directory: " << directory << " (" << ec.message() << ")" << std::endl;
+		return false;
+	}
+	
+	if(!region::init(directory)) return false;
+	
+	std::vector<uint32_t> voxels(SECTOR_VOLUME);
+	std::vector<uint32_t> edits;
+	
+	for(const std::filesystem::directory_entry& file : files)
+	{
+		long long rx, ry, rz;
+		char end;
+		if(std::sscanf(file.path().filename().string().c_str(), "r.%lld.%lld.%lld.vx%c", &rx, &ry, &rz, &end) != 4 || end != 'r') continue;
+		
+		for(int64_t x = rx * REGION_SIZE; x < (rx + 1) * REGION_SIZE; x++)
+			for(int64_t y = ry * REGION_SIZE; y < (ry + 1) * REGION_SIZE; y++)
+				for(int64_t z = rz * REGION_SIZE; z < (rz + 1) * REGION_SIZE; z++)
+					if(region::load_sector(x, y, z, voxels.data(), voxels.size(), &edits) != REGION_LOAD_FAILED) sectors->push_back({x, y, z});
+	}
+	
+	region::deinit();
+	return true;
+}
+
+//Evicts the region files from the page cache, the same way DEBUG_REGION_COLD_CACHE does.
+static void drop_page_cache(const std::string& directory)
+{
+	std::error_code ec;
+	for(const std::filesystem::directory_entry& file : std::filesystem::directory_iterator(directory, ec))
+	{
+		if(file.path().extension() != ".vxr") continue;
+		
+		mapped_file map;
+		if(map.open(file.path().string())) map.drop_page_cache();
+	}
+}
+
+//Times region::load_sector() alone, from opening the region files to decoding every payload into voxels.
+static bool bench_loads(const std::string& directory, const std::vector<sector_position>& sectors, bool cold)
+{
+	std::vector<uint32_t> voxels(SECTOR_VOLUME);
+	std::vector<uint32_t> edits;
+	
+	for(uint32_t round = 0; round < BENCH_ROUNDS; round++)
+	{
+		if(cold) drop_page_cache(directory);
+		if(!region::init(directory)) return false;
+		
+		uint32_t loaded = 0;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		
+		for(const sector_position& p : sectors)
+			if(region::load_sector(p.x, p.y, p.z, voxels.data(), voxels.size(), &edits) != REGION_LOAD_FAILED) loaded++;
+		
+		double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+		region::deinit();
+		
+		std::cout << "[VOX|INF] " << (cold ? "Cold" : "Warm") << " round " << round << ": " << loaded << "/" << sectors.size() << " sectors loaded, "
+			<< us / sectors.size() << " us per sector, " << sectors.size() / (us / 1000000) << " sectors/s." << std::endl;
+		
+		if(loaded != sectors.size()) return false;
+	}
+	
+	return true;
+}
+
+//Usage: region_bench [save directory]
+//Measures warm and cold sector loads of a save, e.g. saves/world/. Without one, saves a sample world of its own and checks it reads back first.
+//Cold loads are only cold where the OS lets the page cache be dropped, and where the disk isn't cached below it (e.g. by a VM host).
+int main(int argc, char** argv)
+{
+	std::string directory = argc > 1 ? argv[1] : SAMPLE_DIRECTORY;
+	if(directory.back() != '/' && directory.back() != '\\') directory += '/';
+	
+	std::vector<sector_position> sectors;
+	if(argc > 1)
+	{
+		if(!find_saved_sectors(directory, &sectors)) return 1;
+	}
+	else if(!write_sample_world(directory, &sectors)) return 1;
+	
+	if(sectors.empty())
+	{
+		std::cerr << "[VOX|ERR] No saved sectors in " << directory << "." << std::endl;
+		return 1;
+	}
+	
+	if(!bench_loads(directory, sectors, false) || !bench_loads(directory, sectors, true)) return 1;
+	
+	return 0;
+}
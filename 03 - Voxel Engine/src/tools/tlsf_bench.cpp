@@ -0,0 +1,261 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "../utils/tlsf.h"
+
+#define REGION_SIZE (128ull << 20)
+#define OPERATION_COUNT 100000
+#define DEFAULT_LIVE_ALLOCATIONS 500
+
+//An allocation followed by freeing a random live one once there are too many. Sizes are 1 KB to 513 KB, alignments those of buffers and images.
+struct operation
+{
+	uint64_t size, alignment;
+	uint32_t victim;
+};
+
+//The sub-allocator alloc.cpp used before TLSF: a free list per page sorted by offset, searched first fit and merged on every free.
+class free_list_allocator
+{
+	public:
+		bool allocate(uint64_t size, uint64_t alignment, uint32_t* page, uint64_t* offset)
+		{
+			for(uint32_t i = 0; i < pages.size(); i++)
+			{
+				std::vector<free_node>& list = pages[i];
+				for(size_t j = 0; j < list.size(); j++)
+				{
+					uint64_t start = (list[j].offset + alignment - 1) / alignment * alignment;
+					uint64_t end = list[j].offset + list[j].size;
+					if(start + size > end) continue;
+					
+					if(start == list[j].offset)
+					{
+						list[j].offset += size;
+						list[j].size -= size;
+						if(list[j].size == 0) list.erase(list.begin() + j);
+					}
+					else
+					{
+						list[j].size = start - list[j].offset;
+						if(start + size < end) list.insert(list.begin() + j + 1, {start + size, end - start - size});
+					}
+					
+					*page = i;
+					*offset = start;
+					return true;
+				}
+			}
+			
+			return false;
+		}
+		
+		void add_page(uint64_t size)
+		{
+			pages.push_back({{0, size}});
+		}
+		
+		void free(uint32_t page, uint64_t offset, uint64_t size)
+		{
+			std::vector<free_node>& list = pages[page];
+			
+			size_t position = 0;
+			while(position < list.size() && list[position].offset <= offset) position++;
+			list.insert(list.begin() + position, {offset, size});
+			
+			for(size_t i = 1; i < list.size(); i++)
+			{
+				if(list[i - 1].offset + list[i - 1].size != list[i].offset) continue;
+				
+				list[i - 1].size += list[i].size;
+				list.erase(list.begin() + i);
+				i--;
+			}
+		}
+		
+		uint32_t get_page_count() const
+		{
+			return pages.size();
+		}
+	private:
+		struct free_node
+		{
+			uint64_t offset, size;
+		};
+		
+		std::vector<std::vector<free_node> > pages;
+};
+
+static double get_elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+//Checks alignment and overlaps of every allocation, that everything merges back into whole regions, and that freeing a handle twice is refused.
+static bool check_tlsf(const std::vector<operation>& operations, uint32_t live_count)
+{
+	tlsf_allocator allocator;
+	uint32_t regions = 0;
+	
+	std::vector<tlsf_allocation> live;
+	std::map<std::pair<uint32_t, uint64_t>, uint64_t> used;
+	
+	for(const operation& op : operations)
+	{
+		tlsf_allocation a;
+		while(!allocator.allocate(op.size, op.alignment, &a))
+			allocator.add_region(regions++, REGION_SIZE);
+		
+		if(a.offset % op.alignment != 0)
+		{
+			std::cerr << "[UTILS|ERR] Allocation at " << a.offset << " isn't aligned to " << op.alignment << "." << std::endl;
+			return false;
+		}
+		
+		std::map<std::pair<uint32_t, uint64_t>, uint64_t>::iterator next = used.lower_bound({a.region, a.offset});
+		bool overlaps_next = next != used.end() && next->first.first == a.region && next->first.second < a.offset + a.size;
+		bool overlaps_prev = next != used.begin() && std::prev(next)->first.first == a.region && std::prev(next)->first.second + std::prev(next)->second > a.offset;
+		if(overlaps_next || overlaps_prev)
+		{
+			std::cerr << "[UTILS|ERR] Allocation at " << a.offset << " in region " << a.region << " overlaps another one." << std::endl;
+			return false;
+		}
+		
+		used[{a.region, a.offset}] = a.size;
+		live.push_back(a);
+		
+		if(live.size() > live_count)
+		{
+			size_t victim = op.victim % live.size();
+			used.erase({live[victim].region, live[victim].offset});
+			allocator.free(live[victim].block);
+			live[victim] = live.back();
+			live.pop_back();
+		}
+	}
+	
+	//The last block freed gets merged into its neighbours, so its handle is freed again afterwards.
+	uint32_t last_block = TLSF_NONE;
+	for(const tlsf_allocation& a : live)
+	{
+		allocator.free(a.block);
+		last_block = a.block;
+	}
+	
+	for(uint32_t i = 0; i < regions; i++)
+	{
+		if(!allocator.is_region_free(i))
+		{
+			std::cerr << "[UTILS|ERR] Region " << i << " didn't merge back into one free block." << std::endl;
+			return false;
+		}
+	}
+	
+	std::cout << "[UTILS|INF] Freeing a merged block again (this should be refused):" << std::endl;
+	if(last_block != TLSF_NONE) allocator.free(last_block);
+	
+	if(allocator.get_free_size() != regions * REGION_SIZE)
+	{
+		std::cerr << "[UTILS|ERR] Freeing a handle twice changed the free size." << std::endl;
+		return false;
+	}
+	
+	return true;
+}
+
+static double run_tlsf(const std::vector<operation>& operations, uint32_t live_count, uint32_t* regions)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	
+	tlsf_allocator allocator;
+	std::vector<uint32_t> live;
+	*regions = 0;
+	
+	for(const operation& op : operations)
+	{
+		tlsf_allocation a;
+		while(!allocator.allocate(op.size, op.alignment, &a))
+			allocator.add_region((*regions)++, REGION_SIZE);
+		
+		live.push_back(a.block);
+		
+		if(live.size() > live_count)
+		{
+			size_t victim = op.victim % live.size();
+			allocator.free(live[victim]);
+			live[victim] = live.back();
+			live.pop_back();
+		}
+	}
+	
+	return get_elapsed_ms(start);
+}
+
+static double run_free_list(const std::vector<operation>& operations, uint32_t live_count, uint32_t* pages)
+{
+	struct allocation
+	{
+		uint32_t page;
+		uint64_t offset, size;
+	};
+	
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	
+	free_list_allocator allocator;
+	std::vector<allocation> live;
+	
+	for(const operation& op : operations)
+	{
+		allocation a = {0, 0, op.size};
+		while(!allocator.allocate(op.size, op.alignment, &a.page, &a.offset))
+			allocator.add_page(REGION_SIZE);
+		
+		live.push_back(a);
+		
+		if(live.size() > live_count)
+		{
+			size_t victim = op.victim % live.size();
+			allocator.free(live[victim].page, live[victim].offset, live[victim].size);
+			live[victim] = live.back();
+			live.pop_back();
+		}
+	}
+	
+	*pages = allocator.get_page_count();
+	return get_elapsed_ms(start);
+}
+
+//Usage: tlsf_bench [live allocations]
+//Runs 100k random allocation/free pairs through tlsf_allocator, checking every allocation, then times them against the old free list.
+int main(int argc, char** argv)
+{
+	uint32_t live_count = argc > 1 ? std::atoi(argv[1]) : DEFAULT_LIVE_ALLOCATIONS;
+	
+	std::mt19937 random(7);
+	const uint64_t alignments[] = {4, 16, 256, 4096};
+	
+	std::vector<operation> operations(OPERATION_COUNT);
+	for(operation& op : operations)
+	{
+		op.size = (1024 + random() % (512 * 1024)) & ~(uint64_t) 3;
+		op.alignment = alignments[random() % 4];
+		op.victim = random();
+	}
+	
+	if(!check_tlsf(operations, live_count)) return 1;
+	
+	uint32_t regions, pages;
+	double tlsf_ms = run_tlsf(operations, live_count, &regions);
+	double free_list_ms = run_free_list(operations, live_count, &pages);
+	
+	std::cout << "[UTILS|INF] " << OPERATION_COUNT << " allocations, " << live_count << " alive at once:" << std::endl;
+	std::cout << "[UTILS|INF]   TLSF: " << tlsf_ms << " ms, " << regions << " regions" << std::endl;
+	std::cout << "[UTILS|INF]   Free list: " << free_list_ms << " ms, " << pages << " pages" << std::endl;
+	
+	return 0;
+}
@@ -4,6 +4,20 @@
 #define DEFAULT_PAGE_SIZE 128*MB
 #define STAGING_MEMORY_SIZE 128*MB
 
+//Offsets into the staging memory are aligned to this, which covers the texel size of every image format used.
+#define STAGING_ALIGNMENT 16
+
+//Uploads bigger than this are split up and every chunk is submitted on its own, so the next one can be written while the last one is copied.
+#define STAGING_CHUNK_SIZE 16*MB
+
+//Uncomment to put staged vertex and index buffers (sector meshes) in pages of their own, split up by a buddy allocator instead of the TLSF allocators.
+//More memory is lost to rounding sizes up, but freed meshes always merge back into power of two blocks the next mesh fits into.
+//#define ALLOC_BUDDY_MESH_BUFFERS
+#define BUDDY_PAGE_FACTOR 26
+
+//Uncomment to record every allocation and free to a trace, which alloc_trace::replay() can run again without a GPU.
+//#define ALLOC_RECORD_TRACE "alloc_trace.txt"
+
 #define PAGE_MEMORY_TYPE_DEVICE_LOCAL VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
 #define PAGE_MEMORY_TYPE_HOST_AVAILABLE VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
 
@@ -14,29 +28,103 @@
 #define USAGE_DEPTH_ATTACHMENT VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
 #define USAGE_UNIFORM_BUFFER VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT
 #define USAGE_GENERIC_CPU_ACCESS_BUFFER VK_BUFFER_USAGE_TRANSFER_DST_BIT
+#define USAGE_GEOMETRY_BUFFER (VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT)
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <fstream>
 #include <iostream>
 
 #include "../renderer/vksetup.h"
 
+#include "alloc_trace.h"
 #include "image_utils.h"
+#include "page_allocator.h"
+#include "staging_ring.h"
+#include "vksync.h"
 
 static uint32_t requested_allocation_type;
 
-struct freelist_node
-{
-	size_t offset, size;
-};
+//Always counted, see alloc::get_stats().
+static uint32_t usage_counts[ALLOC_USAGE_COUNT];
+static uint64_t usage_sizes[ALLOC_USAGE_COUNT];
+static uint64_t allocation_total = 0;
+static uint64_t free_total = 0;
 
-struct mem_page
+//Where the rates were last measured from.
+static std::chrono::steady_clock::time_point rate_start;
+static uint64_t rate_start_allocations = 0;
+static uint64_t rate_start_frees = 0;
+
+//Graphics and transfer queue families, if they differ. Buffers both queues use at once are shared between them instead of changing hands.
+static std::vector<uint32_t> shared_queue_families;
+
+class vulkan_memory_backend : public memory_backend
 {
-	VkDeviceMemory memory;
-	std::vector<freelist_node> freelist;
-	
-	uint32_t memory_type_index;
+	public:
+		bool allocate_page(uint32_t page, uint32_t memory_type, uint64_t size) override
+		{
+			VkMemoryAllocateInfo info_alloc{};
+			info_alloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			info_alloc.allocationSize = size;
+			info_alloc.memoryTypeIndex = memory_type;
+			
+			VkDeviceMemory memory;
+			VkResult r = vkAllocateMemory(get_device(), &info_alloc, nullptr, &memory);
+			VERIFY(r, "Failed to allocate Vulkan memory (when creating new memory page).");
+			
+			if(page >= memories.size())
+			{
+				memories.resize(page + 1, VK_NULL_HANDLE);
+				mappings.resize(page + 1, nullptr);
+			}
+			
+			memories[page] = memory;
+			
+			//Host visible pages stay mapped until they're freed, writing to them is just a memcpy.
+			VkPhysicalDeviceMemoryProperties memory_properties;
+			vkGetPhysicalDeviceMemoryProperties(get_selected_physical_device(), &memory_properties);
+			
+			if(memory_properties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+			{
+				r = vkMapMemory(get_device(), memory, 0, VK_WHOLE_SIZE, 0, &mappings[page]);
+				VERIFY_NORETURN(r, "Failed to map Vulkan memory (when creating new memory page).");
+			}
+			
+		#ifdef DEBUG_PRINT_SUCCESS
+			std::cout << "[ALLOC|INF] Allocated memory page " << page << " of " << size << " bytes (memory type " << memory_type << ")." << std::endl;
+		#endif
+			return true;
+		}
+		
+		void free_page(uint32_t page) override
+		{
+			if(mappings[page] != nullptr) vkUnmapMemory(get_device(), memories[page]);
+			vkFreeMemory(get_device(), memories[page], nullptr);
+			
+			memories[page] = VK_NULL_HANDLE;
+			mappings[page] = nullptr;
+		}
+		
+		//nullptr for pages that aren't host visible.
+		uint8_t* get_mapping(uint32_t page) const
+		{
+			return (uint8_t*) mappings[page];
+		}
+		
+		VkDeviceMemory get_memory(uint32_t page) const
+		{
+			return memories[page];
+		}
+	private:
+		std::vector<VkDeviceMemory> memories;
+		std::vector<void*> mappings;
 };
 
-static std::vector<mem_page> mem_pages;
+static vulkan_memory_backend vulkan_backend;
+static page_allocator device_pages(&vulkan_backend, DEFAULT_PAGE_SIZE, BUDDY_PAGE_FACTOR);
 
 std::string requested_allocation_to_string(uint32_t usage)
 {
@@ -56,6 +144,10 @@ std::string requested_allocation_to_string(uint32_t usage)
 			return "ALLOC_USAGE_COLOR_ATTACHMENT";
 		case ALLOC_USAGE_COLOR_ATTACHMENT_CPU_VISIBLE:
 			return "ALLOC_USAGE_COLOR_ATTACHMENT_CPU_VISIBLE";
+		case ALLOC_USAGE_GENERIC_BUFFER_CPU_VISIBLE:
+			return "ALLOC_USAGE_GENERIC_BUFFER_CPU_VISIBLE";
+		case ALLOC_USAGE_GEOMETRY_BUFFER:
+			return "ALLOC_USAGE_GEOMETRY_BUFFER";
 		default:
 			return "UNKNOWN OR INVALID ALLOC USAGE";
 	}
@@ -146,142 +238,41 @@ static uint32_t find_suitable_memory_type(uint32_t type_filter, VkMemoryProperty
 	return UINT32_MAX;
 }
 
-void fill_memory(VkDeviceSize size, uint32_t offset, uint32_t page, uint32_t freelist_index)
-{
-	if(offset == mem_pages[page].freelist[freelist_index].offset)
-	{
-		mem_pages[page].freelist[freelist_index].offset += size;
-		mem_pages[page].freelist[freelist_index].size -= size;
-		
-		if(mem_pages[page].freelist[freelist_index].size == 0)
-		{
-			mem_pages[page].freelist.erase(mem_pages[page].freelist.begin() + freelist_index);
-		}
-	}
-	else
-	{
-		uint32_t end = mem_pages[page].freelist[freelist_index].offset + mem_pages[page].freelist[freelist_index].size;
-		mem_pages[page].freelist[freelist_index].size = offset - mem_pages[page].freelist[freelist_index].offset;
-
-		if(offset + size < end)
-		{
-			freelist_node fn;
-
-			fn.offset = offset + size;
-			fn.size = end - fn.offset;
-
-			mem_pages[page].freelist.insert(mem_pages[page].freelist.begin() + freelist_index + 1, fn);
-		}
-	}
-}
-
 void debug_print_page_freelist(size_t page_index)
 {
-	std::cout << "[ALLOC|INF] Free list for page " << page_index << ":" << std::endl;
-	for(size_t i = 0; i < mem_pages[page_index].freelist.size(); i++)
-	{
-		freelist_node f = mem_pages[page_index].freelist[i];
-		std::cout << "  [" << f.offset << ", " << f.size << "]" << std::endl;
-	}
-	std::cout << "[ALLOC|INF] End freelist." << std::endl;
+	device_pages.print_page(page_index);
 }
 
-bool create_new_memory_page(uint32_t memory_type_index, size_t size)
+static void count_allocation(uint32_t usage, uint64_t size)
 {
-	mem_page page;
-	
-	VkMemoryAllocateInfo info_alloc{};
-	info_alloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	info_alloc.allocationSize = size;
-	info_alloc.memoryTypeIndex = memory_type_index;
-		
-	VkResult r = vkAllocateMemory(get_device(), &info_alloc, nullptr, &(page.memory));
-	VERIFY(r, "Failed to allocate Vulkan memory (when creating new memory page).");
-	
-	page.freelist.resize(1);
-	
-	page.freelist[0].offset = 0;
-	page.freelist[0].size = size;
-	
-	page.memory_type_index = memory_type_index;
-	
-	mem_pages.push_back(page);
+	allocation_total++;
+	if(usage >= ALLOC_USAGE_COUNT) return;
 	
-	debug_print_page_freelist(mem_pages.size() - 1);
-	return true;
+	usage_counts[usage]++;
+	usage_sizes[usage] += size;
 }
 
-bool create_new_memory_page(uint32_t memory_type_index)
+static void count_free(uint32_t usage, uint64_t size)
 {
-	return create_new_memory_page(memory_type_index, DEFAULT_PAGE_SIZE);
+	free_total++;
+	if(usage >= ALLOC_USAGE_COUNT) return;
+	
+	usage_counts[usage]--;
+	usage_sizes[usage] -= size;
 }
 
-bool find_page_space(VkMemoryRequirements memory_requirements, uint32_t memory_properties, size_t* page_index, size_t* page_memory_offset, size_t* freelist_index)
+bool find_page_space(VkMemoryRequirements memory_requirements, uint32_t memory_properties, bool buddy, page_allocation* allocation)
 {
 	uint32_t memory_type_index = find_suitable_memory_type(memory_requirements.memoryTypeBits, memory_properties);
 	if(memory_type_index == UINT32_MAX) return false;
-
-	if(memory_requirements.size >= DEFAULT_PAGE_SIZE)
-	{
-		size_t pi = mem_pages.size();
-		if(!create_new_memory_page(memory_type_index, memory_requirements.size)) return false;
-		*page_index = pi;
-		*page_memory_offset = 0;
-		*freelist_index = 0;
-		return true;
-	}
-	
-	for(size_t i = 0; i < mem_pages.size(); i++)
-	{
-	#ifdef DEBUG_ALLOC_PRINT
-		std::cout << "Scanning page " << i << "..." << std::endl;
-	#endif
-		if(mem_pages[i].memory_type_index != memory_type_index)
-		{
-		#ifdef DEBUG_ALLOC_PRINT
-			std::cout << "Skipped." << std::endl;
-		#endif
-			continue;
-		}
-		for(size_t j = 0; j < mem_pages[i].freelist.size(); j++)
-		{
-			if(mem_pages[i].freelist[j].size >= memory_requirements.size)
-			{
-				if(mem_pages[i].freelist[j].offset % memory_requirements.alignment == 0) //Freelist node offset happens to match alignment.
-				{
-					*page_index = i;
-					*page_memory_offset = mem_pages[i].freelist[j].offset;
-					*freelist_index = j;
-					return true;
-				}
-				else
-				{
-					uint32_t next_alignment = (mem_pages[i].freelist[j].offset / memory_requirements.alignment) + 1;
-					next_alignment *= memory_requirements.alignment;
-					uint32_t diff = next_alignment - mem_pages[i].freelist[j].offset;
-
-					if(mem_pages[i].freelist[j].size - diff >= memory_requirements.size)
-					{
-						*page_index = i;
-						*page_memory_offset = next_alignment;
-						*freelist_index = j;
-						return true;
-					}
-				}
-			}
-		}
-	}
 	
-	size_t pi = mem_pages.size();
-	if(!create_new_memory_page(memory_type_index)) return false;
-	*page_index = pi;
-	*page_memory_offset = 0;
-	*freelist_index = 0;
+	if(!device_pages.allocate(memory_type_index, memory_requirements.size, memory_requirements.alignment, buddy, allocation)) return false;
 	
+	alloc_trace::record_allocation(memory_type_index, memory_requirements.size, memory_requirements.alignment, buddy, *allocation);
 	return true;
 }
 
-bool allocate_buffer(alloc::buffer* buf, void* data, uint32_t memory_type, VkDeviceSize size, VkBufferUsageFlags usage)
+bool allocate_buffer(alloc::buffer* buf, void* data, uint32_t memory_type, VkDeviceSize size, VkBufferUsageFlags usage, bool buddy, bool shared)
 {
 	alloc::buffer b;
 	
@@ -291,6 +282,13 @@ bool allocate_buffer(alloc::buffer* buf, void* data, uint32_t memory_type, VkDev
 	info_buffer.usage = usage;
 	info_buffer.sharingMode = ALLOC_DEFAULT_BUFFER_SHARING_MODE;
 	
+	if(shared && !shared_queue_families.empty())
+	{
+		info_buffer.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		info_buffer.queueFamilyIndexCount = shared_queue_families.size();
+		info_buffer.pQueueFamilyIndices = shared_queue_families.data();
+	}
+	
 	VkResult r = vkCreateBuffer(get_device(), &info_buffer, nullptr, &(b.vk_buffer));
 	VERIFY(r, "Failed to create Vulkan buffer (during allocation).");
 	
@@ -301,22 +299,23 @@ bool allocate_buffer(alloc::buffer* buf, void* data, uint32_t memory_type, VkDev
 	std::cout << "[ALLOC|INF] Attempting an allocation of " << size << " (" << mem_req.size << ") bytes for a buffer." << std::endl;
 #endif
 	
-	size_t page, memory_offset, freelist_index;
-	if(!find_page_space(mem_req, memory_type, &page, &memory_offset, &freelist_index)) return false;
+	page_allocation allocation;
+	if(!find_page_space(mem_req, memory_type, buddy, &allocation)) return false;
 
 #ifdef DEBUG_ALLOC_PRINT	
-	std::cout << "[ALLOC|INF] Space found: page " << page << ", offset: " << memory_offset << " bytes." << std::endl;
+	std::cout << "[ALLOC|INF] Space found: page " << allocation.page << ", offset: " << allocation.offset << " bytes." << std::endl;
 #endif
 	
 	b.allocation_size = mem_req.size;
-	b.page_index = page;
-	b.page_offset = memory_offset;
-	vkBindBufferMemory(get_device(), b.vk_buffer, mem_pages[page].memory, memory_offset);
-	
-	fill_memory(mem_req.size, memory_offset, page, freelist_index);
+	b.allocation_block = allocation.block;
+	b.page_index = allocation.page;
+	b.page_offset = allocation.offset;
+	b.usage = requested_allocation_type;
+	count_allocation(b.usage, b.allocation_size);
+	vkBindBufferMemory(get_device(), b.vk_buffer, vulkan_backend.get_memory(b.page_index), b.page_offset);
 	
 #ifdef DEBUG_ALLOC_PRINT
-	debug_print_page_freelist(page);
+	debug_print_page_freelist(b.page_index);
 #endif
 	
 	*buf = b;
@@ -356,26 +355,27 @@ bool allocate_image(alloc::image* image, uint16_t width, uint16_t height, VkForm
 	std::cout << "Attempting an allocation of " << mem_req.size << " bytes for an image." << std::endl;
 #endif
 
-	size_t page, memory_offset, freelist_index;
-	if(!find_page_space(mem_req, memory_type, &page, &memory_offset, &freelist_index)) return false;
+	page_allocation allocation;
+	if(!find_page_space(mem_req, memory_type, false, &allocation)) return false;
 
 #ifdef DEBUG_ALLOC_PRINT
-	std::cout << "Space found: page " << page << ", offset: " << memory_offset << " bytes." << std::endl;
+	std::cout << "Space found: page " << allocation.page << ", offset: " << allocation.offset << " bytes." << std::endl;
 #endif
 
 	img.allocation_size = mem_req.size;
-	img.page_index = page;
-	img.page_offset = memory_offset;
+	img.allocation_block = allocation.block;
+	img.page_index = allocation.page;
+	img.page_offset = allocation.offset;
+	img.usage = requested_allocation_type;
+	count_allocation(img.usage, img.allocation_size);
 	img.vk_format = image_format;
 	img.vk_image_layout = VK_IMAGE_LAYOUT_UNDEFINED;
 	img.width = width;
 	img.height = height;
-	vkBindImageMemory(get_device(), img.vk_image, mem_pages[page].memory, memory_offset);
-
-	fill_memory(mem_req.size, memory_offset, page, freelist_index);
+	vkBindImageMemory(get_device(), img.vk_image, vulkan_backend.get_memory(img.page_index), img.page_offset);
 
 #ifdef DEBUG_ALLOC_PRINT
-	debug_print_page_freelist(page);
+	debug_print_page_freelist(img.page_index);
 #endif
 
 	*image = img;
@@ -384,150 +384,434 @@ bool allocate_image(alloc::image* image, uint16_t width, uint16_t height, VkForm
 
 bool allocate_host_buffer(alloc::buffer* buf, void* data, VkDeviceSize size, VkBufferUsageFlags usage)
 {
-	if(!allocate_buffer(buf, data, PAGE_MEMORY_TYPE_HOST_AVAILABLE, size, usage)) return false;
+	if(!allocate_buffer(buf, data, PAGE_MEMORY_TYPE_HOST_AVAILABLE, size, usage, false, false)) return false;
 
-	uint16_t page = buf->page_index;
-	uint32_t offset = buf->page_offset;
-	
-	alloc::map_data_to_memory(data, mem_pages[page].memory, offset, size);
+	memcpy(vulkan_backend.get_mapping(buf->page_index) + buf->page_offset, data, size);
 	
 	return true;
 }
 
+//One submission of upload commands, and the fence telling when the GPU is done with them and with the staging memory they read.
+//Slots are reused, command buffers and all, once that's the case.
+struct upload_slot
+{
+	uint64_t serial;
+	fence* done;
+	VkCommandBuffer cmd_buffer;
+	
+	//Only used on a dedicated transfer queue. The graphics queue waits for the transfer, then takes ownership of the buffers it wrote.
+	VkCommandBuffer acquire_cmd_buffer;
+	semaphore* transferred;
+};
+
+struct upload_queue
+{
+	VkQueue queue;
+	VkCommandPool pool;
+	uint32_t family;
+	
+	//The slot commands are being recorded into, only valid while recording is set.
+	upload_slot recording_slot;
+	bool recording;
+	
+	//Buffers written by the commands being recorded, handed over to the graphics queue along with them.
+	std::vector<VkBuffer> written_buffers;
+	
+	//Set once a barrier makes every earlier upload visible to buffer to buffer copies. Cleared by the next upload, and by every new slot.
+	bool copies_synced;
+	
+	std::deque<upload_slot> submitted;
+	std::vector<upload_slot> unused;
+};
+
+static staging_ring staging(STAGING_MEMORY_SIZE);
+
 static VkBuffer alloc_stage_buffer;
 static VkDeviceMemory alloc_stage_memory;
+static uint8_t* alloc_stage_mapping;
 
-static VkQueue staging_queue;
-static VkCommandPool staging_command_pool;
+//Image uploads, layout transitions and readbacks always go through the graphics queue. Staged buffers go through buffer_uploads,
+//which is the dedicated transfer queue if there is one, or the graphics queue again.
+static upload_queue graphics_uploads;
+static upload_queue transfer_uploads;
+static upload_queue* buffer_uploads = &graphics_uploads;
 
-bool stage_buffer(alloc::buffer* buf, void* data, VkDeviceSize size, VkBufferUsageFlags usage)
+static bool upload_batch_open = false;
+
+//Serials are shared by both queues, completed_upload_serial is the highest one that every submission up to has finished.
+static uint64_t upload_serial = 0;
+static uint64_t completed_upload_serial = 0;
+
+static bool is_dedicated_transfer(const upload_queue* uploads)
+{
+	return uploads != &graphics_uploads;
+}
+
+//Gives back the slots of every submission the GPU has finished, and the staging regions nothing older is holding on to anymore.
+//With wait set, waits for the oldest submission first.
+static void retire_uploads(bool wait)
 {
-	if(size >= STAGING_MEMORY_SIZE)
+	upload_queue* queues[] = {&graphics_uploads, &transfer_uploads};
+	
+	if(wait)
 	{
-		std::cerr << "[ALLOC|ERR] Requested staging memory too large.\n\tMax size is " << STAGING_MEMORY_SIZE << " bytes.\n\tRequested size is " << size << " bytes." << std::endl;
-		return false;
+		upload_queue* oldest = nullptr;
+		for(upload_queue* q : queues)
+			if(!q->submitted.empty() && (oldest == nullptr || q->submitted.front().serial < oldest->submitted.front().serial)) oldest = q;
+		
+		if(oldest != nullptr) oldest->submitted.front().done->wait();
 	}
 	
-	if(!allocate_buffer(buf, data, PAGE_MEMORY_TYPE_DEVICE_LOCAL, size, usage)) return false;
-	
-	alloc::map_data_to_memory(data, alloc_stage_memory, 0, size);
-	alloc::copy_buffer(alloc_stage_buffer, buf->vk_buffer, staging_command_pool, staging_queue, size);
+	uint64_t completed = upload_serial;
 	
-	//debug_print_page_freelist(page);
+	for(upload_queue* q : queues)
+	{
+		while(!q->submitted.empty() && q->submitted.front().done->is_signaled())
+		{
+			q->submitted.front().done->reset();
+			q->unused.push_back(q->submitted.front());
+			q->submitted.pop_front();
+		}
+		
+		if(!q->submitted.empty()) completed = std::min(completed, q->submitted.front().serial - 1);
+	}
 	
-	return true;
+	if(completed != completed_upload_serial)
+	{
+		completed_upload_serial = completed;
+		staging.release(completed);
+	}
 }
 
-bool alloc::copy_buffer(VkBuffer src, VkBuffer dst, VkCommandPool pool, VkQueue queue, VkDeviceSize data_size)
+static VkCommandBuffer record_uploads(upload_queue* uploads)
 {
-	VkCommandBufferAllocateInfo info_alloc{};
-	info_alloc.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	info_alloc.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	info_alloc.commandPool = pool;
-	info_alloc.commandBufferCount = 1;
+	if(uploads->recording) return uploads->recording_slot.cmd_buffer;
 	
-	VkCommandBuffer cmd_buffer;
-	vkAllocateCommandBuffers(get_device(), &info_alloc, &cmd_buffer);
+	retire_uploads(false);
+	
+	upload_slot& slot = uploads->recording_slot;
+	
+	if(!uploads->unused.empty())
+	{
+		slot = uploads->unused.back();
+		uploads->unused.pop_back();
+	}
+	else
+	{
+		VkCommandBufferAllocateInfo info_alloc{};
+		info_alloc.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		info_alloc.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		info_alloc.commandPool = uploads->pool;
+		info_alloc.commandBufferCount = 1;
+		
+		vkAllocateCommandBuffers(get_device(), &info_alloc, &slot.cmd_buffer);
+		slot.done = new fence();
+		
+		slot.acquire_cmd_buffer = VK_NULL_HANDLE;
+		slot.transferred = nullptr;
+		
+		if(is_dedicated_transfer(uploads))
+		{
+			info_alloc.commandPool = graphics_uploads.pool;
+			vkAllocateCommandBuffers(get_device(), &info_alloc, &slot.acquire_cmd_buffer);
+			slot.transferred = new semaphore();
+		}
+	}
 	
+	//Both pools let their command buffers be reset one by one, beginning one again resets it.
 	VkCommandBufferBeginInfo info_begin{};
 	info_begin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 	info_begin.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 	
-	vkBeginCommandBuffer(cmd_buffer, &info_begin);
+	vkBeginCommandBuffer(slot.cmd_buffer, &info_begin);
 	
-	VkBufferCopy copy_region{};
-	copy_region.srcOffset = 0;
-	copy_region.dstOffset = 0;
-	copy_region.size = data_size;
+	uploads->recording = true;
+	uploads->copies_synced = false;
+	return slot.cmd_buffer;
+}
+
+//Submits the commands recorded so far, without waiting for them. An open batch goes on in a new slot.
+static bool flush_uploads(upload_queue* uploads)
+{
+	if(!uploads->recording) return true;
+	uploads->recording = false;
 	
-	vkCmdCopyBuffer(cmd_buffer, src, dst, 1, &copy_region);
+	upload_slot& slot = uploads->recording_slot;
+	VkResult r;
 	
-	vkEndCommandBuffer(cmd_buffer);
+	if(!is_dedicated_transfer(uploads))
+	{
+		//Nothing waits for uploads on the host, so whatever is submitted after them has to wait for them on the GPU.
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+		
+		vkCmdPipelineBarrier(slot.cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		vkEndCommandBuffer(slot.cmd_buffer);
+		
+		VkSubmitInfo info_submit{};
+		info_submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		info_submit.commandBufferCount = 1;
+		info_submit.pCommandBuffers = &slot.cmd_buffer;
+		
+		r = vkQueueSubmit(uploads->queue, 1, &info_submit, slot.done->get_handle());
+	}
+	else
+	{
+		//The buffers are exclusive to one queue family. The transfer queue releases them, the graphics queue acquires them once the transfer is done.
+		std::vector<VkBufferMemoryBarrier> barriers(uploads->written_buffers.size());
+		for(size_t i = 0; i < barriers.size(); i++)
+		{
+			barriers[i] = {};
+			barriers[i].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			barriers[i].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barriers[i].srcQueueFamilyIndex = uploads->family;
+			barriers[i].dstQueueFamilyIndex = graphics_uploads.family;
+			barriers[i].buffer = uploads->written_buffers[i];
+			barriers[i].offset = 0;
+			barriers[i].size = VK_WHOLE_SIZE;
+		}
+		
+		uploads->written_buffers.clear();
+		
+		vkCmdPipelineBarrier(slot.cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, barriers.size(), barriers.data(), 0, nullptr);
+		vkEndCommandBuffer(slot.cmd_buffer);
+		
+		for(size_t i = 0; i < barriers.size(); i++)
+		{
+			barriers[i].srcAccessMask = 0;
+			barriers[i].dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+		}
+		
+		VkCommandBufferBeginInfo info_begin{};
+		info_begin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		info_begin.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		
+		vkBeginCommandBuffer(slot.acquire_cmd_buffer, &info_begin);
+		vkCmdPipelineBarrier(slot.acquire_cmd_buffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, barriers.size(), barriers.data(), 0, nullptr);
+		vkEndCommandBuffer(slot.acquire_cmd_buffer);
+		
+		VkSemaphore transferred = slot.transferred->get_handle();
+		VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+		
+		VkSubmitInfo info_transfer{};
+		info_transfer.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		info_transfer.commandBufferCount = 1;
+		info_transfer.pCommandBuffers = &slot.cmd_buffer;
+		info_transfer.signalSemaphoreCount = 1;
+		info_transfer.pSignalSemaphores = &transferred;
+		
+		VkSubmitInfo info_acquire{};
+		info_acquire.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		info_acquire.waitSemaphoreCount = 1;
+		info_acquire.pWaitSemaphores = &transferred;
+		info_acquire.pWaitDstStageMask = &wait_stage;
+		info_acquire.commandBufferCount = 1;
+		info_acquire.pCommandBuffers = &slot.acquire_cmd_buffer;
+		
+		//The fence goes on the acquire, which can't finish before the transfer does.
+		r = vkQueueSubmit(uploads->queue, 1, &info_transfer, VK_NULL_HANDLE);
+		if(r == VK_SUCCESS) r = vkQueueSubmit(graphics_uploads.queue, 1, &info_acquire, slot.done->get_handle());
+	}
 	
-	VkSubmitInfo info_submit{};
-	info_submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	info_submit.commandBufferCount = 1;
-	info_submit.pCommandBuffers = &cmd_buffer;
-
-	vkQueueSubmit(queue, 1, &info_submit, VK_NULL_HANDLE);
-	vkQueueWaitIdle(queue);
+	slot.serial = ++upload_serial;
+	staging.close_region(slot.serial);
 	
-	vkFreeCommandBuffers(get_device(), pool, 1, &cmd_buffer);
+	if(r != VK_SUCCESS)
+	{
+		//The region is given back along with the next submission that makes it.
+		uploads->unused.push_back(slot);
+		
+		report_vulkan_error("Failed to submit upload commands.", r);
+		return false;
+	}
 	
+	uploads->submitted.push_back(slot);
 	return true;
 }
 
-bool alloc::copy_data_to_image(alloc::image* img, void* data, uint32_t width, uint32_t height, uint32_t depth, VkImageAspectFlags aspect)
+static bool flush_all_uploads()
 {
-	return copy_data_to_image(img, data, width, height, depth, aspect, staging_command_pool, staging_queue);
+	bool flushed = flush_uploads(&graphics_uploads);
+	if(is_dedicated_transfer(buffer_uploads)) flushed &= flush_uploads(buffer_uploads);
+	
+	return flushed;
 }
 
-bool alloc::copy_data_to_image(alloc::image* img, void* data, uint32_t width, uint32_t height, uint32_t depth, VkImageAspectFlags aspect, VkCommandPool pool, VkQueue queue)
+//Returns where to write size bytes of staging data, and sets offset to where they are in the staging buffer.
+//Waits for older submissions if the staging memory is full, after submitting what's been recorded so far.
+static uint8_t* reserve_staging(VkDeviceSize size, VkDeviceSize* offset)
 {
-	VkCommandBufferAllocateInfo info_alloc{};
-	info_alloc.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	info_alloc.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	info_alloc.commandPool = pool;
-	info_alloc.commandBufferCount = 1;
-	
-	VkCommandBuffer cmd_buffer;
-	vkAllocateCommandBuffers(get_device(), &info_alloc, &cmd_buffer);
+	retire_uploads(false);
 	
-	VkCommandBufferBeginInfo info_begin{};
-	info_begin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	info_begin.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	uint64_t staging_offset;
+	while(!staging.reserve(size, STAGING_ALIGNMENT, &staging_offset))
+	{
+		if(graphics_uploads.recording || buffer_uploads->recording)
+		{
+			flush_all_uploads();
+			continue;
+		}
+		
+		if(completed_upload_serial == upload_serial)
+		{
+			std::cerr << "[ALLOC|ERR] Requested staging memory too large.\n\tMax size is " << STAGING_MEMORY_SIZE << " bytes.\n\tRequested size is " << size << " bytes." << std::endl;
+			return nullptr;
+		}
+		
+		retire_uploads(true);
+	}
 	
-	vkBeginCommandBuffer(cmd_buffer, &info_begin);
+	*offset = staging_offset;
+	return alloc_stage_mapping + staging_offset;
+}
 
-	VkBufferImageCopy copy_region{};
-	copy_region.bufferOffset = 0;
+//Shared buffers aren't handed over to the graphics queue, they belong to both.
+static bool stage_to_buffer(VkBuffer dst, VkDeviceSize dst_offset, void* data, VkDeviceSize size, bool shared)
+{
+	for(VkDeviceSize uploaded = 0; uploaded < size;)
+	{
+		VkDeviceSize chunk = std::min<VkDeviceSize>(size - uploaded, STAGING_CHUNK_SIZE);
+		bool last = uploaded + chunk == size;
+		
+		//Chunks are never bigger than the staging memory, so only the first one can fail, before anything is copied into the buffer.
+		VkDeviceSize staging_offset;
+		uint8_t* staged = reserve_staging(chunk, &staging_offset);
+		if(staged == nullptr) return false;
+		
+		memcpy(staged, (uint8_t*) data + uploaded, chunk);
+		
+		VkBufferCopy copy_region{};
+		copy_region.srcOffset = staging_offset;
+		copy_region.dstOffset = dst_offset + uploaded;
+		copy_region.size = chunk;
+		
+		vkCmdCopyBuffer(record_uploads(buffer_uploads), alloc_stage_buffer, dst, 1, &copy_region);
+		buffer_uploads->copies_synced = false;
+		
+		//The transfer queue keeps the buffer until its last chunk is copied.
+		if(last && !shared && is_dedicated_transfer(buffer_uploads)) buffer_uploads->written_buffers.push_back(dst);
+		if(!last) flush_uploads(buffer_uploads);
+		
+		uploaded += chunk;
+	}
 	
-	//Indicating that the pixels are tightly packed.
-	copy_region.bufferRowLength = 0;
-	copy_region.bufferImageHeight = 0;
-
-	copy_region.imageSubresource.aspectMask = aspect;
-	copy_region.imageSubresource.mipLevel = 0;
-	copy_region.imageSubresource.baseArrayLayer = 0;
-	copy_region.imageSubresource.layerCount = 1;
+	if(upload_batch_open) return true;
+	return flush_uploads(buffer_uploads);
+}
 
-	copy_region.imageOffset = {0, 0, 0};
-	copy_region.imageExtent = {width, height, 1};
+bool stage_buffer(alloc::buffer* buf, void* data, VkDeviceSize size, VkBufferUsageFlags usage)
+{
+#ifdef ALLOC_BUDDY_MESH_BUFFERS
+	bool buddy = true;
+#else
+	bool buddy = false;
+#endif
+	
+	if(!allocate_buffer(buf, data, PAGE_MEMORY_TYPE_DEVICE_LOCAL, size, usage, buddy, false)) return false;
+	
+	if(!stage_to_buffer(buf->vk_buffer, 0, data, size, false))
+	{
+		alloc::free(*buf);
+		return false;
+	}
+	
+	//debug_print_page_freelist(page);
+	
+	return true;
+}
 
-	vkCmdCopyBufferToImage(cmd_buffer, alloc_stage_buffer, img->vk_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
+void alloc::begin_upload_batch()
+{
+	upload_batch_open = true;
+}
 
-	vkEndCommandBuffer(cmd_buffer);
+bool alloc::copy_buffer(VkBuffer src, VkBuffer dst, VkDeviceSize data_size)
+{
+	VkBufferCopy copy_region{};
+	copy_region.srcOffset = 0;
+	copy_region.dstOffset = 0;
+	copy_region.size = data_size;
 	
-	VkSubmitInfo info_submit{};
-	info_submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	info_submit.commandBufferCount = 1;
-	info_submit.pCommandBuffers = &cmd_buffer;
-
-	vkQueueSubmit(queue, 1, &info_submit, VK_NULL_HANDLE);
-	vkQueueWaitIdle(queue);
+	vkCmdCopyBuffer(record_upload_commands(), src, dst, 1, &copy_region);
 	
-	vkFreeCommandBuffers(get_device(), pool, 1, &cmd_buffer);
+	return finish_upload_commands();
+}
 
-	return true;
+bool alloc::copy_buffer_range(alloc::buffer* src, VkDeviceSize src_offset, alloc::buffer* dst, VkDeviceSize dst_offset, VkDeviceSize size)
+{
+	VkBufferCopy copy_region{};
+	copy_region.srcOffset = src_offset;
+	copy_region.dstOffset = dst_offset;
+	copy_region.size = size;
+	
+	VkCommandBuffer cmd_buffer = record_uploads(buffer_uploads);
+	
+	//The source was written by an earlier upload, and the destination may still be read by an earlier copy. One barrier covers every copy until the next upload.
+	if(!buffer_uploads->copies_synced)
+	{
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		
+		vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		buffer_uploads->copies_synced = true;
+	}
+	
+	//Geometry buffers belong to both queues, nothing is handed over.
+	vkCmdCopyBuffer(cmd_buffer, src->vk_buffer, dst->vk_buffer, 1, &copy_region);
+	
+	if(upload_batch_open) return true;
+	return flush_uploads(buffer_uploads);
 }
 
-bool alloc::copy_image_to_buffer(alloc::image* img, alloc::buffer* buffer, uint32_t width, uint32_t height, VkImageAspectFlags aspect)
+bool alloc::copy_data_to_image(alloc::image* img, void* data, uint32_t width, uint32_t height, uint32_t depth, VkImageAspectFlags aspect)
 {
-	VkCommandBufferAllocateInfo info_alloc{};
-	info_alloc.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	info_alloc.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	info_alloc.commandPool = staging_command_pool;
-	info_alloc.commandBufferCount = 1;
+	VkDeviceSize row_size = (VkDeviceSize) width * (utils::get_format_pixel_size(img->vk_format) >> 3);
 	
-	VkCommandBuffer cmd_buffer;
-	vkAllocateCommandBuffers(get_device(), &info_alloc, &cmd_buffer);
+	//Big images are streamed a few rows at a time, the same way as big buffers.
+	uint32_t chunk_rows = std::max<VkDeviceSize>(STAGING_CHUNK_SIZE / row_size, 1);
 	
-	VkCommandBufferBeginInfo info_begin{};
-	info_begin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	info_begin.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	for(uint32_t row = 0; row < height;)
+	{
+		uint32_t rows = std::min(height - row, chunk_rows);
+		VkDeviceSize size = row_size * rows;
+		
+		VkDeviceSize staging_offset;
+		uint8_t* staged = reserve_staging(size, &staging_offset);
+		if(staged == nullptr) return false;
+		
+		memcpy(staged, (uint8_t*) data + row_size * row, size);
+		
+		VkBufferImageCopy copy_region{};
+		copy_region.bufferOffset = staging_offset;
+		
+		//Indicating that the pixels are tightly packed.
+		copy_region.bufferRowLength = 0;
+		copy_region.bufferImageHeight = 0;
+		
+		copy_region.imageSubresource.aspectMask = aspect;
+		copy_region.imageSubresource.mipLevel = 0;
+		copy_region.imageSubresource.baseArrayLayer = 0;
+		copy_region.imageSubresource.layerCount = 1;
+		
+		copy_region.imageOffset = {0, (int32_t) row, 0};
+		copy_region.imageExtent = {width, rows, 1};
+		
+		vkCmdCopyBufferToImage(record_upload_commands(), alloc_stage_buffer, img->vk_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
+		
+		row += rows;
+		if(row < height) flush_uploads(&graphics_uploads);
+	}
 	
-	vkBeginCommandBuffer(cmd_buffer, &info_begin);
+	//The layout transition after the copy is what makes it visible, so nothing is waited for here.
+	return finish_upload_commands();
+}
 
+bool alloc::copy_image_to_buffer(alloc::image* img, alloc::buffer* buffer, uint32_t width, uint32_t height, VkImageAspectFlags aspect)
+{
 	VkBufferImageCopy copy_region{};
 	copy_region.bufferOffset = 0;
 	
@@ -543,20 +827,14 @@ bool alloc::copy_image_to_buffer(alloc::image* img, alloc::buffer* buffer, uint3
 	copy_region.imageOffset = {0, 0, 0};
 	copy_region.imageExtent = {width, height, 1};
 
-	vkCmdCopyImageToBuffer(cmd_buffer, img->vk_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer->vk_buffer, 1, &copy_region);
-
-	vkEndCommandBuffer(cmd_buffer);
-	
-	VkSubmitInfo info_submit{};
-	info_submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	info_submit.commandBufferCount = 1;
-	info_submit.pCommandBuffers = &cmd_buffer;
+	vkCmdCopyImageToBuffer(record_upload_commands(), img->vk_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer->vk_buffer, 1, &copy_region);
 
-	vkQueueSubmit(staging_queue, 1, &info_submit, VK_NULL_HANDLE);
-	vkQueueWaitIdle(staging_queue);
+	//The buffer is read on the host right after, so this one is submitted and waited for even in a batch.
+	//Only its own fence is waited for, uploads still running on the transfer queue don't hold it up.
+	if(!flush_uploads(&graphics_uploads)) return false;
 	
-	vkFreeCommandBuffers(get_device(), staging_command_pool, 1, &cmd_buffer);
-
+	graphics_uploads.submitted.back().done->wait();
+	retire_uploads(false);
 	return true;
 }
 
@@ -602,12 +880,26 @@ bool alloc::create_buffer(VkBuffer* buffer, VkDeviceMemory* memory, uint32_t siz
 
 void alloc::deinit()
 {
-	while(mem_pages.size() > 0)
+	flush_all_uploads();
+	while(completed_upload_serial < upload_serial)
+		retire_uploads(true);
+	
+	//The command buffers go with their pools.
+	for(upload_queue* uploads : {&graphics_uploads, &transfer_uploads})
 	{
-		vkFreeMemory(get_device(), mem_pages[0].memory, nullptr);
-		mem_pages.erase(mem_pages.begin());
+		for(size_t i = 0; i < uploads->unused.size(); i++)
+		{
+			delete uploads->unused[i].done;
+			delete uploads->unused[i].transferred;
+		}
+		
+		uploads->unused.clear();
 	}
 	
+	device_pages.free_pages();
+	alloc_trace::end_recording();
+	
+	vkUnmapMemory(get_device(), alloc_stage_memory);
 	destroy_buffer(&alloc_stage_buffer, &alloc_stage_memory);
 #ifdef DEBUG_PRINT_SUCCESS
 	std::cout << "[ALLOC|INF] Deinitialized memory allocator." << std::endl;
@@ -620,6 +912,12 @@ void alloc::destroy_buffer(VkBuffer* buffer, VkDeviceMemory* memory)
 	vkFreeMemory(get_device(), *memory, nullptr);
 }
 
+bool alloc::finish_upload_commands()
+{
+	if(upload_batch_open) return true;
+	return flush_uploads(&graphics_uploads);
+}
+
 void alloc::free(buffer buf)
 {
 #ifdef DEBUG_ALLOC_PRINT
@@ -629,35 +927,11 @@ void alloc::free(buffer buf)
 	vkDestroyBuffer(get_device(), buf.vk_buffer, nullptr);
 	
 	uint16_t page = buf.page_index;
-	uint32_t offset = buf.page_offset;
-	
-	std::vector<freelist_node>& fl = mem_pages[page].freelist;
-	
-	size_t free_insert_location = 0;
-	for(size_t i = 0; i < fl.size(); i++)
-	{
-		if(fl[i].offset > offset)
-			break;
-		free_insert_location++;
-	}
 	
-	freelist_node node;
-	
-	node.offset = offset;
-	node.size = buf.allocation_size;
-	
-	fl.insert(fl.begin() + free_insert_location, node);
-	
-	for(size_t i = 1; i < fl.size(); i++)
-	{
-		size_t previous_end = fl[i - 1].offset + fl[i - 1].size;
-		if(previous_end == fl[i].offset)
-		{
-			fl[i - 1].size += fl[i].size;
-			fl.erase(fl.begin() + i);
-			i--;
-		}
-	}
+	page_allocation allocation = {page, buf.page_offset, buf.allocation_size, buf.allocation_block};
+	alloc_trace::record_free(allocation);
+	device_pages.free(allocation);
+	count_free(buf.usage, buf.allocation_size);
 	
 #ifdef DEBUG_ALLOC_PRINT
 	debug_print_page_freelist(page);
@@ -673,35 +947,11 @@ void alloc::free(image img)
 	vkDestroyImage(get_device(), img.vk_image, nullptr);
 	
 	uint16_t page = img.page_index;
-	uint32_t offset = img.page_offset;
-	
-	std::vector<freelist_node>& fl = mem_pages[page].freelist;
-	
-	size_t free_insert_location = 0;
-	for(size_t i = 0; i < fl.size(); i++)
-	{
-		if(fl[i].offset > offset)
-			break;
-		free_insert_location++;
-	}
-	
-	freelist_node node;
-	
-	node.offset = offset;
-	node.size = img.allocation_size;
 	
-	fl.insert(fl.begin() + free_insert_location, node);
-	
-	for(size_t i = 1; i < fl.size(); i++)
-	{
-		size_t previous_end = fl[i - 1].offset + fl[i - 1].size;
-		if(previous_end == fl[i].offset)
-		{
-			fl[i - 1].size += fl[i].size;
-			fl.erase(fl.begin() + i);
-			i--;
-		}
-	}
+	page_allocation allocation = {page, img.page_offset, img.allocation_size, img.allocation_block};
+	alloc_trace::record_free(allocation);
+	device_pages.free(allocation);
+	count_free(img.usage, img.allocation_size);
 	
 #ifdef DEBUG_ALLOC_PRINT
 	debug_print_page_freelist(page);
@@ -710,7 +960,17 @@ void alloc::free(image img)
 
 VkDeviceMemory alloc::get_memory_page(uint16_t index)
 {
-	return mem_pages[index].memory;
+	return vulkan_backend.get_memory(index);
+}
+
+void* alloc::get_page_mapping(uint16_t index)
+{
+	return vulkan_backend.get_mapping(index);
+}
+
+bool alloc::get_page_stats(uint16_t index, memory_stats* stats)
+{
+	return device_pages.get_page_stats(index, stats);
 }
 
 VkBuffer alloc::get_staging_buffer()
@@ -720,56 +980,114 @@ VkBuffer alloc::get_staging_buffer()
 
 VkCommandPool alloc::get_staging_command_pool()
 {
-	return staging_command_pool;
+	return graphics_uploads.pool;
 }
 
 VkQueue alloc::get_staging_queue()
 {
-	return staging_queue;
+	return graphics_uploads.queue;
+}
+
+void alloc::get_stats(stats* stats)
+{
+	for(uint32_t i = 0; i < ALLOC_USAGE_COUNT; i++)
+	{
+		stats->usage_count[i] = usage_counts[i];
+		stats->usage_size[i] = usage_sizes[i];
+	}
+	
+	stats->allocations = allocation_total;
+	stats->frees = free_total;
+	
+	auto now = std::chrono::steady_clock::now();
+	double elapsed = std::chrono::duration<double>(now - rate_start).count();
+	
+	stats->allocation_rate = elapsed > 0 ? (allocation_total - rate_start_allocations) / elapsed : 0;
+	stats->free_rate = elapsed > 0 ? (free_total - rate_start_frees) / elapsed : 0;
+	
+	rate_start = now;
+	rate_start_allocations = allocation_total;
+	rate_start_frees = free_total;
+	
+	stats->page_count = 0;
+	for(uint32_t i = 0; i < device_pages.get_page_count(); i++)
+		if(device_pages.get_page_size(i) != 0) stats->page_count++;
+	
+	device_pages.get_total_stats(&stats->memory);
+}
+
+uint64_t alloc::get_upload_token()
+{
+	return upload_serial;
 }
 
-void alloc::init(VkQueue queue, VkCommandPool pool)
+void alloc::init(VkQueue queue, VkCommandPool pool, uint32_t queue_family, VkQueue transfer_queue, VkCommandPool transfer_pool, uint32_t transfer_queue_family)
 {
 	VkPhysicalDeviceMemoryProperties memory_properties;
 	vkGetPhysicalDeviceMemoryProperties(get_selected_physical_device(), &memory_properties);
 	
 	print_physical_device_memory_properties(memory_properties);
 	
-	staging_queue = queue;
-	staging_command_pool = pool;
+	graphics_uploads.queue = queue;
+	graphics_uploads.pool = pool;
+	graphics_uploads.family = queue_family;
+	graphics_uploads.recording = false;
+	
+	transfer_uploads.queue = transfer_queue;
+	transfer_uploads.pool = transfer_pool;
+	transfer_uploads.family = transfer_queue_family;
+	transfer_uploads.recording = false;
+	
+	//Without a queue family of its own (lavapipe, most integrated GPUs), the transfer queue is just the graphics queue, and gains nothing.
+	if(transfer_queue_family != queue_family)
+	{
+		buffer_uploads = &transfer_uploads;
+		shared_queue_families = {queue_family, transfer_queue_family};
+	#ifdef DEBUG_PRINT_SUCCESS
+		std::cout << "[ALLOC|INF] Staged buffers are uploaded on a dedicated transfer queue (queue family " << transfer_queue_family << ")." << std::endl;
+	#endif
+	}
+	else buffer_uploads = &graphics_uploads;
+	
+#ifdef ALLOC_RECORD_TRACE
+	alloc_trace::start_recording(ALLOC_RECORD_TRACE);
+#endif
 	
 	create_buffer(&alloc_stage_buffer, &alloc_stage_memory, STAGING_MEMORY_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 	
+	//Mapped once for the whole run, uploads are written straight into it.
+	void* mapping;
+	VkResult r = vkMapMemory(get_device(), alloc_stage_memory, 0, VK_WHOLE_SIZE, 0, &mapping);
+	VERIFY_NORETURN(r, "Failed to map the staging memory.");
+	
+	alloc_stage_mapping = (uint8_t*) mapping;
+	
+	rate_start = std::chrono::steady_clock::now();
+	
 #ifdef DEBUG_PRINT_SUCCESS
 	std::cout << "[ALLOC|INF] Memory allocator initialized." << std::endl;
 #endif
 }
 
+bool alloc::is_upload_done(uint64_t token)
+{
+	retire_uploads(false);
+	return token <= completed_upload_serial;
+}
+
 void alloc::map_data_from_buffer(void* dst, alloc::buffer* src, size_t offset, size_t size)
 {
-	void* map;
-	
-	VkDeviceMemory mem = mem_pages[src->page_index].memory;
-	
-	vkMapMemory(get_device(), mem, offset + src->page_offset, size, 0, &map);
-		memcpy(dst, map, size);
-	vkUnmapMemory(get_device(), mem);
+	memcpy(dst, vulkan_backend.get_mapping(src->page_index) + src->page_offset + offset, size);
 }
 
 void alloc::map_data_to_buffer(void* data, alloc::buffer* buffer, size_t offset, size_t size)
 {
-	size_t os = buffer->page_offset + offset;
-
-	VkDeviceMemory mem = mem_pages[buffer->page_index].memory;
-	map_data_to_memory(data, mem, os, size);
+	memcpy(vulkan_backend.get_mapping(buffer->page_index) + buffer->page_offset + offset, data, size);
 }
 
 void alloc::map_data_to_buffer(void* data, alloc::buffer* buffer)
 {
-	size_t offset = buffer->page_offset;
-	size_t size = buffer->allocation_size;
-
-	map_data_to_buffer(data, buffer, offset, size);
+	map_data_to_buffer(data, buffer, 0, buffer->allocation_size);
 }
 
 void alloc::map_data_to_memory(void* data, VkDeviceMemory memory, size_t offset, size_t size)
@@ -780,13 +1098,10 @@ void alloc::map_data_to_memory(void* data, VkDeviceMemory memory, size_t offset,
 	vkUnmapMemory(get_device(), memory);
 }
 
-void alloc::map_to_staging(void* data, size_t size)
-{
-	map_data_to_memory(data, alloc_stage_memory, 0, size);
-}
-
 bool alloc::new_buffer(buffer* buf, void* data, VkDeviceSize size, uint32_t usage)
 {
+	requested_allocation_type = usage;
+	
 	switch(usage)
 	{
 		case ALLOC_USAGE_STAGED_VERTEX_BUFFER:
@@ -797,6 +1112,8 @@ bool alloc::new_buffer(buffer* buf, void* data, VkDeviceSize size, uint32_t usag
 			return allocate_host_buffer(buf, data, size, USAGE_UNIFORM_BUFFER);
 		case ALLOC_USAGE_GENERIC_BUFFER_CPU_VISIBLE:
 			return allocate_host_buffer(buf, data, size, USAGE_GENERIC_CPU_ACCESS_BUFFER);
+		case ALLOC_USAGE_GEOMETRY_BUFFER:
+			return allocate_buffer(buf, data, PAGE_MEMORY_TYPE_DEVICE_LOCAL, size, USAGE_GEOMETRY_BUFFER, false, true);
 		//case ALLOC_USAGE_IMAGE:
 			//return false;
 		default:
@@ -809,7 +1126,9 @@ bool alloc::new_buffer(buffer* buf, void* data, VkDeviceSize size, uint32_t usag
 
 bool alloc::new_buffer(buffer* buffer, VkDeviceSize size, uint32_t usage)
 {
-	requested_allocation_type = usage;
+	//Geometry buffers start out empty, they're filled range by range.
+	if(usage == ALLOC_USAGE_GEOMETRY_BUFFER) return new_buffer(buffer, nullptr, size, usage);
+	
 	char* data = new char[size];
 
 	for(VkDeviceSize i = 0; i < size; i++)
@@ -842,4 +1161,83 @@ bool alloc::new_image(image* image, uint16_t width, uint16_t height, VkFormat im
 	}
 
 	return false;
-}
\ No newline at end of file
+}
+
+void alloc::print_memory_stats()
+{
+	device_pages.print_stats();
+	
+	for(uint32_t i = 0; i < ALLOC_USAGE_COUNT; i++)
+		if(usage_counts[i] > 0) std::cout << "[ALLOC|INF] " << requested_allocation_to_string(i) << ": " << usage_counts[i] << " allocations, " << usage_sizes[i] << " bytes." << std::endl;
+}
+
+void alloc::release_empty_pages()
+{
+#ifdef DEBUG_PRINT_SUCCESS
+	uint64_t released = device_pages.release_empty_pages();
+	if(released > 0) std::cout << "[ALLOC|INF] Gave " << released << " bytes of empty memory pages back." << std::endl;
+#else
+	device_pages.release_empty_pages();
+#endif
+}
+
+VkCommandBuffer alloc::record_upload_commands()
+{
+	return record_uploads(&graphics_uploads);
+}
+
+uint64_t alloc::submit_upload_batch()
+{
+	upload_batch_open = false;
+	flush_all_uploads();
+	
+	return upload_serial;
+}
+
+bool alloc::upload_to_buffer(alloc::buffer* buf, VkDeviceSize offset, void* data, VkDeviceSize size)
+{
+	return stage_to_buffer(buf->vk_buffer, offset, data, size, true);
+}
+
+void alloc::wait_for_upload(uint64_t token)
+{
+	while(completed_upload_serial < token)
+		retire_uploads(true);
+}
+
+bool alloc::write_heap_map(const std::string& path)
+{
+	std::ofstream out(path);
+	if(!out.is_open())
+	{
+		std::cerr << "[ALLOC|ERR] Failed to open heap map file: " << path << std::endl;
+		return false;
+	}
+	
+	//No rates: measuring them here would cut short the ones get_stats() reports.
+	memory_stats memory;
+	device_pages.get_total_stats(&memory);
+	
+	out << "{\n\t\"capacity\": " << memory.capacity << ",\n\t\"allocated\": " << memory.allocated_size << ",\n\t\"requested\": " << memory.requested_size
+		<< ",\n\t\"largest_free_block\": " << memory.largest_free_block << ",\n\t\"external_fragmentation\": " << get_external_fragmentation(memory)
+		<< ",\n\t\"allocations\": " << allocation_total << ",\n\t\"frees\": " << free_total << ",\n\t\"usages\": {";
+	
+	for(uint32_t i = 0; i < ALLOC_USAGE_COUNT; i++)
+		out << (i == 0 ? "\n" : ",\n") << "\t\t\"" << requested_allocation_to_string(i) << "\": {\"count\": " << usage_counts[i] << ", \"size\": " << usage_sizes[i] << "}";
+	
+	out << "\n\t},\n\t\"pages\": ";
+	device_pages.write_heap_map(out);
+	out << "\n}\n";
+	
+	out.close();
+	if(!out.good())
+	{
+		std::cerr << "[ALLOC|ERR] Failed to write heap map file: " << path << std::endl;
+		return false;
+	}
+	
+#ifdef DEBUG_PRINT_SUCCESS
+	std::cout << "[ALLOC|INF] Wrote heap map to " << path << "." << std::endl;
+#endif
+	return true;
+}
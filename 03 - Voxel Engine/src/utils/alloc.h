@@ -1,8 +1,12 @@
 #ifndef _VK_ALLOC_H_
 #define _VK_ALLOC_H_
 
+#include <string>
+
 #include "../../lib/vulkan/vulkan.hpp"
 
+#include "memory_stats.h"
+
 #define ALLOC_USAGE_STAGED_VERTEX_BUFFER 0
 #define ALLOC_USAGE_STAGED_INDEX_BUFFER 1
 #define ALLOC_USAGE_UNIFORM_BUFFER 2
@@ -12,6 +16,11 @@
 #define ALLOC_USAGE_COLOR_ATTACHMENT_CPU_VISIBLE 6
 #define ALLOC_USAGE_GENERIC_BUFFER_CPU_VISIBLE 7
 
+//Device local vertices and indices of many meshes, written range by range through upload_to_buffer().
+#define ALLOC_USAGE_GEOMETRY_BUFFER 8
+
+#define ALLOC_USAGE_COUNT 9
+
 #define ALLOC_DEFAULT_BUFFER_SHARING_MODE VK_SHARING_MODE_EXCLUSIVE
 
 namespace alloc
@@ -23,6 +32,12 @@ namespace alloc
 		uint16_t page_index;
 		uint32_t page_offset;
 		size_t allocation_size;
+		
+		//Handle of the allocation within its page, for freeing it.
+		uint32_t allocation_block;
+		
+		//ALLOC_USAGE_* it was made for.
+		uint32_t usage;
 	};
 
 	struct image
@@ -36,13 +51,42 @@ namespace alloc
 		uint16_t page_index;
 		uint32_t page_offset;
 		size_t allocation_size;
+		
+		//Handle of the allocation within its page, for freeing it.
+		uint32_t allocation_block;
+		
+		//ALLOC_USAGE_* it was made for.
+		uint32_t usage;
 	};
 	
-	bool copy_buffer(VkBuffer src, VkBuffer dst, VkCommandPool pool, VkQueue queue, VkDeviceSize data_size);
+	//Kept up to date on every allocation and free, so it's there in release builds too.
+	struct stats
+	{
+		//Buffers and images alive, and the bytes of memory they take up, by ALLOC_USAGE_*.
+		uint32_t usage_count[ALLOC_USAGE_COUNT];
+		uint64_t usage_size[ALLOC_USAGE_COUNT];
+		
+		//Since init(), and per second since the previous get_stats() call.
+		uint64_t allocations, frees;
+		double allocation_rate, free_rate;
+		
+		//Pages alive, and all of them added up. get_external_fragmentation(memory) is the fragmentation index.
+		uint32_t page_count;
+		memory_stats memory;
+	};
+	
+	//Uploads made until submit_upload_batch() are recorded into one command buffer and submitted together.
+	//Outside of a batch, every upload is submitted on its own. Either way, nothing waits for the GPU unless asked to.
+	void begin_upload_batch();
+	
+	bool copy_buffer(VkBuffer src, VkBuffer dst, VkDeviceSize data_size);
+	
+	//Between ALLOC_USAGE_GEOMETRY_BUFFER buffers, on the queue uploads to them go through. Doesn't wait, like an upload.
+	bool copy_buffer_range(buffer* src, VkDeviceSize src_offset, buffer* dst, VkDeviceSize dst_offset, VkDeviceSize size);
 
 	bool copy_data_to_image(alloc::image* img, void* data, uint32_t width, uint32_t height, uint32_t depth, VkImageAspectFlags aspect);
-	bool copy_data_to_image(alloc::image* img, void* data, uint32_t width, uint32_t height, uint32_t depth, VkImageAspectFlags aspect, VkCommandPool pool, VkQueue queue);
 	
+	//Waits for the copy, even in a batch, so the buffer can be read right after.
 	bool copy_image_to_buffer(alloc::image* img, alloc::buffer* buffer, uint32_t width, uint32_t height, VkImageAspectFlags aspect);
 	
 	bool create_buffer(VkBuffer* buffer, VkDeviceMemory* memory, uint32_t size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memory_properties);
@@ -52,30 +96,68 @@ namespace alloc
 	
 	void destroy_buffer(VkBuffer* buffer, VkDeviceMemory* memory);
 	
+	//Submits the commands recorded since record_upload_commands(), unless a batch is open.
+	bool finish_upload_commands();
+	
 	void free(buffer buf);
 	void free(image buf);
 	
 	VkDeviceMemory get_memory_page(uint16_t index);
+	
+	//Host visible pages are mapped for as long as they exist. nullptr for the others.
+	void* get_page_mapping(uint16_t index);
+
+	//How full a page is. False if there's no such page.
+	bool get_page_stats(uint16_t index, memory_stats* stats);
 
 	VkBuffer get_staging_buffer();
 	VkCommandPool get_staging_command_pool();
 	VkQueue get_staging_queue();
 	
-	void init(VkQueue queue, VkCommandPool pool);
+	//Only adds counters and the allocators' stats up, so it can be called every frame.
+	void get_stats(stats* stats);
+	
+	//Token for everything submitted so far, like the one submit_upload_batch() returns, without submitting anything.
+	uint64_t get_upload_token();
+	
+	//transfer_queue is where staged buffers are uploaded. Pass the graphics queue, pool and family again if there's no dedicated one.
+	void init(VkQueue queue, VkCommandPool pool, uint32_t queue_family, VkQueue transfer_queue, VkCommandPool transfer_pool, uint32_t transfer_queue_family);
+	
+	//Doesn't wait. token is what submit_upload_batch() returned.
+	bool is_upload_done(uint64_t token);
 	
 	void map_data_from_buffer(void* dst, alloc::buffer* src, size_t offset, size_t size);
 
 	void map_data_to_buffer(void* data, alloc::buffer* buffer, size_t offset, size_t size);
 	void map_data_to_buffer(void* data, alloc::buffer* buffer);
 
+	//Only for memory that isn't a page, pages are written to through their mapping.
 	void map_data_to_memory(void* data, VkDeviceMemory memory, size_t offset, size_t size);
 
-	void map_to_staging(void* data, size_t size);
-
 	bool new_buffer(buffer* buffer, void* data, VkDeviceSize size, uint32_t usage);
 	bool new_buffer(buffer* buffer, VkDeviceSize size, uint32_t usage);
 
 	bool new_image(image* image, uint16_t width, uint16_t height, VkFormat image_format, uint32_t usage);
+
+	//Prints usage and fragmentation of every memory type's TLSF allocator, and of every buddy page.
+	void print_memory_stats();
+	
+	//Command buffer of the current upload batch, for copies and layout transitions. Follow up with finish_upload_commands().
+	VkCommandBuffer record_upload_commands();
+	
+	//Gives memory pages nothing is allocated in back to the driver. Pages are otherwise kept until deinit().
+	void release_empty_pages();
+	
+	//Returns a token that tells when everything uploaded so far is done.
+	uint64_t submit_upload_batch();
+	
+	//Stages data into [offset, offset + size) of an ALLOC_USAGE_GEOMETRY_BUFFER buffer. The rest of it can be drawn from meanwhile.
+	bool upload_to_buffer(buffer* buf, VkDeviceSize offset, void* data, VkDeviceSize size);
+	
+	void wait_for_upload(uint64_t token);
+	
+	//Writes the stats and every page's blocks to a JSON file, to see where memory went and how it's split up.
+	bool write_heap_map(const std::string& path);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,132 @@
+#include "alloc_trace.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+static std::ofstream trace_file;
+
+//Page and offset as recorded, packed into a single key.
+static uint64_t get_allocation_key(uint32_t page, uint64_t offset)
+{
+	return ((uint64_t) page << 48) ^ offset;
+}
+
+void alloc_trace::end_recording()
+{
+	if(trace_file.is_open()) trace_file.close();
+}
+
+bool alloc_trace::is_recording()
+{
+	return trace_file.is_open();
+}
+
+void alloc_trace::record_allocation(uint32_t memory_type, uint64_t size, uint64_t alignment, bool buddy, const page_allocation& allocation)
+{
+	if(!trace_file.is_open()) return;
+	trace_file << "a " << memory_type << " " << size << " " << alignment << " " << buddy << " " << allocation.page << " " << allocation.offset << "\n";
+}
+
+void alloc_trace::record_free(const page_allocation& allocation)
+{
+	if(!trace_file.is_open()) return;
+	trace_file << "f " << allocation.page << " " << allocation.offset << "\n";
+}
+
+bool alloc_trace::replay(const std::string& path, page_allocator* allocator, alloc_trace_result* result)
+{
+	struct operation
+	{
+		bool free;
+		uint32_t memory_type;
+		uint64_t size, alignment;
+		bool buddy;
+		uint64_t key;
+	};
+	
+	std::ifstream file(path);
+	if(!file.is_open())
+	{
+		std::cerr << "[UTILS|ERR] Failed to open allocation trace " << path << "." << std::endl;
+		return false;
+	}
+	
+	//Everything is read up front, so only the allocator is timed.
+	std::vector<operation> operations;
+	
+	std::string line;
+	for(size_t number = 1; std::getline(file, line); number++)
+	{
+		if(line.empty()) continue;
+		
+		std::istringstream in(line);
+		char type;
+		operation op = {};
+		uint32_t page;
+		uint64_t offset;
+		
+		in >> type;
+		if(type == 'a') in >> op.memory_type >> op.size >> op.alignment >> op.buddy >> page >> offset;
+		else if(type == 'f') in >> page >> offset;
+		
+		if(in.fail() || (type != 'a' && type != 'f'))
+		{
+			std::cerr << "[UTILS|ERR] Allocation trace " << path << " is malformed at line " << number << "." << std::endl;
+			return false;
+		}
+		
+		op.free = type == 'f';
+		op.key = get_allocation_key(page, offset);
+		operations.push_back(op);
+	}
+	
+	*result = {};
+	
+	std::unordered_map<uint64_t, page_allocation> live;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	
+	for(const operation& op : operations)
+	{
+		if(op.free)
+		{
+			std::unordered_map<uint64_t, page_allocation>::iterator it = live.find(op.key);
+			if(it == live.end()) continue;
+			
+			allocator->free(it->second);
+			live.erase(it);
+			result->free_count++;
+			continue;
+		}
+		
+		page_allocation allocation;
+		if(!allocator->allocate(op.memory_type, op.size, op.alignment, op.buddy, &allocation))
+		{
+			result->failed_count++;
+			continue;
+		}
+		
+		live[op.key] = allocation;
+		result->allocation_count++;
+	}
+	
+	result->elapsed_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	return true;
+}
+
+bool alloc_trace::start_recording(const std::string& path)
+{
+	end_recording();
+	
+	trace_file.open(path, std::ios::trunc);
+	if(!trace_file.is_open())
+	{
+		std::cerr << "[UTILS|ERR] Failed to open " << path << " to record allocations to." << std::endl;
+		return false;
+	}
+	
+	return true;
+}
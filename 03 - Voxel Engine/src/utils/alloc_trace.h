@@ -0,0 +1,36 @@
+#ifndef _ALLOC_TRACE_H_
+#define _ALLOC_TRACE_H_
+
+#include <cstdint>
+#include <string>
+
+#include "page_allocator.h"
+
+struct alloc_trace_result
+{
+	uint64_t allocation_count;
+	uint64_t free_count;
+	uint64_t failed_count;
+	
+	//Only the time spent in the allocator.
+	double elapsed_us;
+};
+
+//Records every allocation and free made through alloc, so a real session can be replayed into any page_allocator later, with any backend.
+//Traces are text, one "a <memory type> <size> <alignment> <buddy> <page> <offset>" or "f <page> <offset>" per line.
+namespace alloc_trace
+{
+	void end_recording();
+	
+	bool is_recording();
+	
+	void record_allocation(uint32_t memory_type, uint64_t size, uint64_t alignment, bool buddy, const page_allocation& allocation);
+	void record_free(const page_allocation& allocation);
+	
+	//Frees are matched to allocations by the page and offset they had when recorded. Returns false if the trace can't be read.
+	bool replay(const std::string& path, page_allocator* allocator, alloc_trace_result* result);
+	
+	bool start_recording(const std::string& path);
+}
+
+#endif
@@ -0,0 +1,162 @@
+#include "buddy.h"
+
+#include <iostream>
+
+#define BUDDY_FREE 0x80
+#define BUDDY_NO_BLOCK 0xFF
+#define BUDDY_NONE UINT32_MAX
+
+buddy_allocator::buddy_allocator(uint8_t factor) : factor(factor)
+{
+	if(this->factor < BUDDY_MIN_FACTOR) this->factor = BUDDY_MIN_FACTOR;
+	order_count = this->factor - BUDDY_MIN_FACTOR + 1;
+	
+	uint32_t unit_count = 1 << (order_count - 1);
+	
+	unit_states.resize(unit_count, BUDDY_NO_BLOCK);
+	requested_sizes.resize(unit_count, 0);
+	free_heads.resize(order_count, BUDDY_NONE);
+	prev_free.resize(unit_count, BUDDY_NONE);
+	next_free.resize(unit_count, BUDDY_NONE);
+	
+	requested_size = 0;
+	allocated_size = 0;
+	allocation_count = 0;
+	free_block_count = 0;
+	
+	insert_free_block(0, order_count - 1);
+}
+
+bool buddy_allocator::allocate(uint64_t size, uint64_t alignment, uint64_t* offset)
+{
+	uint64_t needed = size > alignment ? size : alignment;
+	
+	uint8_t order = 0;
+	while(order < order_count && ((uint64_t) 1 << (BUDDY_MIN_FACTOR + order)) < needed)
+		order++;
+	
+	if(order >= order_count) return false;
+	
+	uint8_t found = order;
+	while(found < order_count && free_heads[found] == BUDDY_NONE)
+		found++;
+	
+	if(found >= order_count) return false;
+	
+	uint32_t unit = free_heads[found];
+	remove_free_block(unit, found);
+	
+	//Hand the upper halves back until the block is as small as it can be.
+	while(found > order)
+	{
+		found--;
+		insert_free_block(unit + (1 << found), found);
+	}
+	
+	unit_states[unit] = order;
+	requested_sizes[unit] = size;
+	
+	requested_size += size;
+	allocated_size += (uint64_t) 1 << (BUDDY_MIN_FACTOR + order);
+	allocation_count++;
+	
+	*offset = (uint64_t) unit << BUDDY_MIN_FACTOR;
+	return true;
+}
+
+void buddy_allocator::free(uint64_t offset)
+{
+	uint32_t unit = offset >> BUDDY_MIN_FACTOR;
+	
+	if(unit >= unit_states.size() || unit_states[unit] == BUDDY_NO_BLOCK || (unit_states[unit] & BUDDY_FREE))
+	{
+		std::cerr << "[UTILS|ERR] Tried to free offset " << offset << ", which isn't allocated." << std::endl;
+		return;
+	}
+	
+	uint8_t order = unit_states[unit];
+	
+	requested_size -= requested_sizes[unit];
+	allocated_size -= (uint64_t) 1 << (BUDDY_MIN_FACTOR + order);
+	allocation_count--;
+	
+	unit_states[unit] = BUDDY_NO_BLOCK;
+	requested_sizes[unit] = 0;
+	
+	while(order + 1 < order_count)
+	{
+		uint32_t buddy = unit ^ (1 << order);
+		if(unit_states[buddy] != (BUDDY_FREE | order)) break;
+		
+		remove_free_block(buddy, order);
+		unit_states[buddy] = BUDDY_NO_BLOCK;
+		
+		unit &= ~(1 << order);
+		order++;
+	}
+	
+	insert_free_block(unit, order);
+}
+
+void buddy_allocator::get_blocks(std::vector<memory_block>* blocks) const
+{
+	//Blocks cover the whole pool, so every block ends where the next one starts.
+	for(uint32_t unit = 0; unit < unit_states.size();)
+	{
+		uint8_t order = unit_states[unit] & ~BUDDY_FREE;
+		
+		blocks->push_back({(uint64_t) unit << BUDDY_MIN_FACTOR, (uint64_t) 1 << (BUDDY_MIN_FACTOR + order), (unit_states[unit] & BUDDY_FREE) != 0});
+		unit += 1 << order;
+	}
+}
+
+uint64_t buddy_allocator::get_size() const
+{
+	return (uint64_t) 1 << factor;
+}
+
+void buddy_allocator::get_stats(memory_stats* stats) const
+{
+	stats->capacity = get_size();
+	stats->requested_size = requested_size;
+	stats->allocated_size = allocated_size;
+	stats->free_size = get_size() - allocated_size;
+	stats->allocation_count = allocation_count;
+	stats->free_block_count = free_block_count;
+	
+	stats->largest_free_block = 0;
+	for(uint8_t order = order_count; order > 0; order--)
+	{
+		if(free_heads[order - 1] != BUDDY_NONE)
+		{
+			stats->largest_free_block = (uint64_t) 1 << (BUDDY_MIN_FACTOR + order - 1);
+			break;
+		}
+	}
+}
+
+void buddy_allocator::insert_free_block(uint32_t unit, uint8_t order)
+{
+	unit_states[unit] = BUDDY_FREE | order;
+	
+	prev_free[unit] = BUDDY_NONE;
+	next_free[unit] = free_heads[order];
+	if(free_heads[order] != BUDDY_NONE) prev_free[free_heads[order]] = unit;
+	
+	free_heads[order] = unit;
+	free_block_count++;
+}
+
+void buddy_allocator::remove_free_block(uint32_t unit, uint8_t order)
+{
+	if(prev_free[unit] != BUDDY_NONE) next_free[prev_free[unit]] = next_free[unit];
+	else free_heads[order] = next_free[unit];
+	
+	if(next_free[unit] != BUDDY_NONE) prev_free[next_free[unit]] = prev_free[unit];
+	
+	prev_free[unit] = BUDDY_NONE;
+	next_free[unit] = BUDDY_NONE;
+	
+	unit_states[unit] = BUDDY_NO_BLOCK;
+	free_block_count--;
+}
@@ -0,0 +1,54 @@
+#ifndef _BUDDY_H_
+#define _BUDDY_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "memory_stats.h"
+
+//Smallest block handed out, as a power of two.
+#define BUDDY_MIN_FACTOR 12
+
+//Splits a (1 << factor) byte pool into power of two blocks. Allocations waste at most half of their block,
+//but a freed block only ever merges with its buddy, so the pool can't fragment into odd sizes.
+//Splitting and merging take at most one step per power of two. Like tlsf_allocator, only offsets are handed out.
+class buddy_allocator
+{
+	public:
+		buddy_allocator(uint8_t factor);
+		
+		//Blocks are aligned to their own size, so alignment only matters when it's bigger than the block. Returns false if no block is free.
+		bool allocate(uint64_t size, uint64_t alignment, uint64_t* offset);
+		
+		void free(uint64_t offset);
+		
+		//Appends every block of the pool, free or not, in order.
+		void get_blocks(std::vector<memory_block>* blocks) const;
+		
+		uint64_t get_size() const;
+		void get_stats(memory_stats* stats) const;
+	private:
+		uint8_t factor;
+		uint8_t order_count;
+		
+		//For every BUDDY_MIN_FACTOR sized unit, the order of the block starting at it (with BUDDY_FREE set if free), or BUDDY_NO_BLOCK.
+		std::vector<uint8_t> unit_states;
+		
+		//What was asked for, for every allocated block, by unit.
+		std::vector<uint64_t> requested_sizes;
+		
+		//Free lists, one per order, linked through the units the blocks start at.
+		std::vector<uint32_t> free_heads;
+		std::vector<uint32_t> prev_free;
+		std::vector<uint32_t> next_free;
+		
+		uint64_t requested_size;
+		uint64_t allocated_size;
+		uint32_t allocation_count;
+		uint32_t free_block_count;
+		
+		void insert_free_block(uint32_t unit, uint8_t order);
+		void remove_free_block(uint32_t unit, uint8_t order);
+};
+
+#endif
@@ -0,0 +1,319 @@
+#include "compress.h"
+
+#include <cstring>
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+
+static void write_varint(std::vector<uint8_t>& out, uint32_t value)
+{
+	while(value >= 0x80)
+	{
+		out.push_back((uint8_t) (value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((uint8_t) value);
+}
+
+static bool read_varint(const uint8_t* data, size_t size, size_t* pos, uint32_t* value)
+{
+	uint32_t v = 0;
+	for(uint8_t shift = 0; shift < 35; shift += 7)
+	{
+		if(*pos >= size) return false;
+		
+		uint8_t byte = data[(*pos)++];
+		v |= (uint32_t) (byte & 0x7f) << shift;
+		
+		if((byte & 0x80) == 0)
+		{
+			*value = v;
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+static uint32_t lz_hash(const uint8_t* data)
+{
+	uint32_t sequence;
+	std::memcpy(&sequence, data, sizeof(sequence));
+	return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+//Lengths that don't fit in their 4 bit nibble continue in extra bytes, each adding up to 255.
+static void write_lz_length(std::vector<uint8_t>& out, size_t length)
+{
+	while(length >= 255)
+	{
+		out.push_back(255);
+		length -= 255;
+	}
+	out.push_back((uint8_t) length);
+}
+
+static bool read_lz_length(const uint8_t* data, size_t size, size_t* pos, size_t* length)
+{
+	uint8_t byte;
+	do
+	{
+		if(*pos >= size) return false;
+		
+		byte = data[(*pos)++];
+		*length += byte;
+	}
+	while(byte == 255);
+	
+	return true;
+}
+
+//A match_length of 0 marks the last sequence, which only carries literals.
+static void write_lz_sequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literal_count, size_t match_length, size_t offset)
+{
+	size_t token_pos = out.size();
+	out.push_back(0);
+	
+	uint8_t token = (uint8_t) ((literal_count >= 15 ? 15 : literal_count) << 4);
+	if(literal_count >= 15) write_lz_length(out, literal_count - 15);
+	
+	out.insert(out.end(), literals, literals + literal_count);
+	
+	if(match_length > 0)
+	{
+		size_t length = match_length - LZ_MIN_MATCH;
+		token |= (uint8_t) (length >= 15 ? 15 : length);
+		
+		out.push_back((uint8_t) (offset & 0xff));
+		out.push_back((uint8_t) (offset >> 8));
+		
+		if(length >= 15) write_lz_length(out, length - 15);
+	}
+	
+	out[token_pos] = token;
+}
+
+bool compress::lz_decompress(const uint8_t* data, size_t size, uint8_t* out, size_t out_size)
+{
+	size_t pos = 0;
+	size_t written = 0;
+	
+	while(pos < size)
+	{
+		uint8_t token = data[pos++];
+		
+		size_t literal_count = token >> 4;
+		if(literal_count == 15 && !read_lz_length(data, size, &pos, &literal_count)) return false;
+		if(literal_count > size - pos || literal_count > out_size - written) return false;
+		
+		std::memcpy(out + written, data + pos, literal_count);
+		pos += literal_count;
+		written += literal_count;
+		
+		if(pos == size) break;
+		if(size - pos < 2) return false;
+		
+		size_t offset = data[pos] | ((size_t) data[pos + 1] << 8);
+		pos += 2;
+		if(offset == 0 || offset > written) return false;
+		
+		size_t length = token & 15;
+		if(length == 15 && !read_lz_length(data, size, &pos, &length)) return false;
+		length += LZ_MIN_MATCH;
+		if(length > out_size - written) return false;
+		
+		//Overlapping matches repeat the last offset bytes, so they have to be copied front to back.
+		uint8_t* dst = out + written;
+		const uint8_t* src = dst - offset;
+		if(offset >= length) std::memcpy(dst, src, length);
+		else for(size_t i = 0; i < length; i++) dst[i] = src[i];
+		
+		written += length;
+	}
+	
+	return written == out_size;
+}
+
+void compress::lz_compress(const uint8_t* data, size_t size, std::vector<uint8_t>& out)
+{
+	//Last position (+1, so 0 means empty) at which each hashed 4 byte sequence was seen.
+	std::vector<uint32_t> table(1 << LZ_HASH_BITS, 0);
+	
+	size_t anchor = 0;
+	size_t pos = 0;
+	
+	while(pos + LZ_MIN_MATCH <= size)
+	{
+		uint32_t hash = lz_hash(data + pos);
+		size_t candidate = table[hash];
+		table[hash] = (uint32_t) (pos + 1);
+		
+		if(candidate == 0 || pos - (candidate - 1) > LZ_MAX_OFFSET || std::memcmp(data + candidate - 1, data + pos, LZ_MIN_MATCH) != 0)
+		{
+			pos++;
+			continue;
+		}
+		
+		size_t match = candidate - 1;
+		size_t length = LZ_MIN_MATCH;
+		while(pos + length < size && data[match + length] == data[pos + length])
+			length++;
+		
+		write_lz_sequence(out, data + anchor, pos - anchor, length, pos - match);
+		
+		pos += length;
+		anchor = pos;
+	}
+	
+	write_lz_sequence(out, data + anchor, size - anchor, 0, 0);
+}
+
+bool compress::rle_decode(const uint8_t* data, size_t size, uint32_t* out, size_t count)
+{
+	size_t pos = 0;
+	size_t written = 0;
+	
+	while(pos < size)
+	{
+		uint32_t run, value;
+		if(!read_varint(data, size, &pos, &run)) return false;
+		if(!read_varint(data, size, &pos, &value)) return false;
+		
+		if(run > count - written) return false;
+		
+		for(uint32_t i = 0; i < run; i++)
+			out[written++] = value;
+	}
+	
+	return written == count;
+}
+
+void compress::rle_encode(const uint32_t* data, size_t count, std::vector<uint8_t>& out)
+{
+	size_t i = 0;
+	while(i < count)
+	{
+		uint32_t value = data[i];
+		size_t run = 1;
+		
+		while(i + run < count && data[i + run] == value && run < UINT32_MAX)
+			run++;
+		
+		write_varint(out, (uint32_t) run);
+		write_varint(out, value);
+		
+		i += run;
+	}
+}
+
+bool compress::rle_decode_columns(const uint8_t* data, size_t size, uint32_t* out, uint32_t side)
+{
+	size_t pos = 0;
+	
+	//Position of the next voxel to be written, columns are walked x-major, then z, then y.
+	uint32_t x = 0, y = 0, z = 0;
+	
+	while(pos < size)
+	{
+		uint32_t run, value;
+		if(!read_varint(data, size, &pos, &run)) return false;
+		if(!read_varint(data, size, &pos, &value)) return false;
+		
+		while(run > 0)
+		{
+			if(x >= side) return false;
+			
+			uint32_t count = side - y < run ? side - y : run;
+			uint32_t* column = out + (size_t) x * side * side + z;
+			
+			for(uint32_t i = 0; i < count; i++)
+				column[(size_t) (y + i) * side] = value;
+			
+			run -= count;
+			y += count;
+			
+			if(y == side)
+			{
+				y = 0;
+				if(++z == side)
+				{
+					z = 0;
+					x++;
+				}
+			}
+		}
+	}
+	
+	return x == side;
+}
+
+void compress::rle_encode_columns(const uint32_t* data, uint32_t side, std::vector<uint8_t>& out)
+{
+	uint32_t value = data[0];
+	uint32_t run = 0;
+	
+	for(uint32_t x = 0; x < side; x++)
+	for(uint32_t z = 0; z < side; z++)
+	{
+		const uint32_t* column = data + (size_t) x * side * side + z;
+		
+		for(uint32_t y = 0; y < side; y++)
+		{
+			uint32_t v = column[(size_t) y * side];
+			if(v != value || run == UINT32_MAX)
+			{
+				write_varint(out, run);
+				write_varint(out, value);
+				
+				value = v;
+				run = 0;
+			}
+			
+			run++;
+		}
+	}
+	
+	write_varint(out, run);
+	write_varint(out, value);
+}
+
+bool compress::sparse_decode(const uint8_t* data, size_t size, std::vector<uint32_t>& pairs)
+{
+	size_t pos = 0;
+	
+	uint32_t pair_count;
+	if(!read_varint(data, size, &pos, &pair_count)) return false;
+	
+	//Every pair takes at least two bytes, so anything claiming more than that is corrupt.
+	if(pair_count > size) return false;
+	
+	pairs.resize(pair_count * 2);
+	
+	uint32_t index = 0;
+	for(uint32_t i = 0; i < pair_count; i++)
+	{
+		uint32_t delta, value;
+		if(!read_varint(data, size, &pos, &delta)) return false;
+		if(!read_varint(data, size, &pos, &value)) return false;
+		
+		index += delta;
+		pairs[i * 2] = index;
+		pairs[i * 2 + 1] = value;
+	}
+	
+	return pos == size;
+}
+
+void compress::sparse_encode(const uint32_t* pairs, size_t pair_count, std::vector<uint8_t>& out)
+{
+	write_varint(out, (uint32_t) pair_count);
+	
+	uint32_t previous = 0;
+	for(size_t i = 0; i < pair_count; i++)
+	{
+		write_varint(out, pairs[i * 2] - previous);
+		write_varint(out, pairs[i * 2 + 1]);
+		previous = pairs[i * 2];
+	}
+}
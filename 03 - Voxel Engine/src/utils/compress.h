@@ -0,0 +1,27 @@
+#ifndef _COMPRESS_H_
+#define _COMPRESS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace compress
+{
+	//Byte-oriented LZ77 in the style of LZ4: (literal run, back-reference) sequences with 16 bit offsets and no entropy coding, so decoding is mostly memcpy.
+	bool lz_decompress(const uint8_t* data, size_t size, uint8_t* out, size_t out_size);
+	void lz_compress(const uint8_t* data, size_t size, std::vector<uint8_t>& out);
+	
+	//Sparse (index, value) pairs, given flattened and sorted by index. Indices are delta-coded against the previous one.
+	bool sparse_decode(const uint8_t* data, size_t size, std::vector<uint32_t>& pairs);
+	void sparse_encode(const uint32_t* pairs, size_t pair_count, std::vector<uint8_t>& out);
+	
+	//Runs are stored as (run length, value) pairs, both written as LEB128 varints.
+	bool rle_decode(const uint8_t* data, size_t size, uint32_t* out, size_t count);
+	void rle_encode(const uint32_t* data, size_t count, std::vector<uint8_t>& out);
+	
+	//Same encoding as above, but for a side^3 [x][y][z] array walked column by column along Y, where terrain has its longest runs.
+	bool rle_decode_columns(const uint8_t* data, size_t size, uint32_t* out, uint32_t side);
+	void rle_encode_columns(const uint32_t* data, uint32_t side, std::vector<uint8_t>& out);
+}
+
+#endif
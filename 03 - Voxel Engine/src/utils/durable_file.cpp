@@ -0,0 +1,173 @@
+#include "durable_file.h"
+
+#include <iostream>
+
+#ifdef _WIN32
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+durable_file::durable_file()
+{
+	size = 0;
+	
+#ifdef _WIN32
+	file_handle = INVALID_HANDLE_VALUE;
+#else
+	fd = -1;
+#endif
+}
+
+durable_file::~durable_file()
+{
+	close();
+}
+
+bool durable_file::append(const void* data, size_t size)
+{
+	if(!is_open()) return false;
+	
+#ifdef _WIN32
+	DWORD written = 0;
+	if(!WriteFile(file_handle, data, (DWORD) size, &written, nullptr) || written != size) return false;
+#else
+	const char* ptr = (const char*) data;
+	size_t remaining = size;
+	
+	//A single write() covers the whole batch, unless it gets interrupted.
+	while(remaining > 0)
+	{
+		ssize_t written = ::write(fd, ptr, remaining);
+		if(written <= 0) return false;
+		
+		ptr += written;
+		remaining -= (size_t) written;
+	}
+#endif
+	
+	this->size += size;
+	return true;
+}
+
+void durable_file::close()
+{
+#ifdef _WIN32
+	if(file_handle != INVALID_HANDLE_VALUE) CloseHandle(file_handle);
+	file_handle = INVALID_HANDLE_VALUE;
+#else
+	if(fd != -1) ::close(fd);
+	fd = -1;
+#endif
+	
+	size = 0;
+}
+
+size_t durable_file::get_size() const
+{
+	return size;
+}
+
+bool durable_file::is_open() const
+{
+#ifdef _WIN32
+	return file_handle != INVALID_HANDLE_VALUE;
+#else
+	return fd != -1;
+#endif
+}
+
+bool durable_file::open(const std::string& path)
+{
+	close();
+	
+#ifdef _WIN32
+	file_handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(file_handle == INVALID_HANDLE_VALUE)
+	{
+		std::cerr << "[UTILS|ERR] Failed to open file: " << path << std::endl;
+		return false;
+	}
+	
+	LARGE_INTEGER file_size;
+	if(!GetFileSizeEx(file_handle, &file_size))
+	{
+		close();
+		return false;
+	}
+	
+	size = (size_t) file_size.QuadPart;
+	
+	LARGE_INTEGER zero{};
+	SetFilePointerEx(file_handle, zero, nullptr, FILE_END);
+#else
+	fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+	if(fd == -1)
+	{
+		std::cerr << "[UTILS|ERR] Failed to open file: " << path << std::endl;
+		return false;
+	}
+	
+	struct stat st;
+	if(fstat(fd, &st) != 0)
+	{
+		close();
+		return false;
+	}
+	
+	size = (size_t) st.st_size;
+#endif
+	
+	return true;
+}
+
+bool durable_file::sync()
+{
+	if(!is_open()) return false;
+	
+#ifdef _WIN32
+	return FlushFileBuffers(file_handle) != 0;
+#else
+	return fsync(fd) == 0;
+#endif
+}
+
+bool durable_file::sync_path(const std::string& path)
+{
+#ifdef _WIN32
+	HANDLE handle = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(handle == INVALID_HANDLE_VALUE) return false;
+	
+	bool result = FlushFileBuffers(handle) != 0;
+	CloseHandle(handle);
+	return result;
+#else
+	int path_fd = ::open(path.c_str(), O_RDONLY);
+	if(path_fd == -1) return false;
+	
+	bool result = fsync(path_fd) == 0;
+	::close(path_fd);
+	return result;
+#endif
+}
+
+bool durable_file::truncate(size_t size)
+{
+	if(!is_open()) return false;
+	
+#ifdef _WIN32
+	LARGE_INTEGER position;
+	position.QuadPart = (LONGLONG) size;
+	if(!SetFilePointerEx(file_handle, position, nullptr, FILE_BEGIN) || !SetEndOfFile(file_handle)) return false;
+#else
+	if(ftruncate(fd, (off_t) size) != 0) return false;
+#endif
+	
+	this->size = size;
+	return sync();
+}
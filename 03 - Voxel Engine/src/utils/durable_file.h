@@ -0,0 +1,43 @@
+#ifndef _DURABLE_FILE_H_
+#define _DURABLE_FILE_H_
+
+#include <cstddef>
+#include <string>
+
+//Append-only file with an explicit sync, for data that has to survive a crash.
+class durable_file
+{
+	public:
+		durable_file();
+		~durable_file();
+		
+		//Appends with a single write call. The data is only guaranteed to be on disk after sync().
+		bool append(const void* data, size_t size);
+		
+		void close();
+		
+		size_t get_size() const;
+		
+		bool is_open() const;
+		
+		//Opens (or creates) the file for appending.
+		bool open(const std::string& path);
+		
+		//Blocks until everything appended so far is on disk.
+		bool sync();
+		
+		//Flushes a file that was written through some other handle (e.g. an fstream) to disk.
+		static bool sync_path(const std::string& path);
+		
+		bool truncate(size_t size);
+	private:
+		size_t size;
+		
+	#ifdef _WIN32
+		void* file_handle;
+	#else
+		int fd;
+	#endif
+};
+
+#endif
@@ -0,0 +1,297 @@
+#include "geometry_pool.h"
+
+#include <algorithm>
+#include <iostream>
+
+geometry_pool::geometry_pool(uint32_t vertex_stride, uint64_t block_size) : vertex_stride(vertex_stride), block_size(block_size)
+{
+	bound_block = TLSF_NONE;
+	evacuated_block = TLSF_NONE;
+	next_evacuation_frame = 0;
+	frame = 0;
+}
+
+geometry_pool::~geometry_pool()
+{
+	for(size_t i = 0; i < blocks.size(); i++)
+		if(blocks[i].size != 0) alloc::free(blocks[i].buffer);
+}
+
+bool geometry_pool::add_block(uint64_t size, uint32_t* index)
+{
+	alloc::buffer b;
+	if(!alloc::new_buffer(&b, size, ALLOC_USAGE_GEOMETRY_BUFFER))
+	{
+		std::cerr << "[UTILS|ERR] Failed to create geometry block of " << size << " bytes." << std::endl;
+		return false;
+	}
+	
+	*index = blocks.size();
+	for(uint32_t i = 0; i < blocks.size(); i++)
+	{
+		if(blocks[i].size == 0)
+		{
+			*index = i;
+			break;
+		}
+	}
+	
+	if(*index == blocks.size()) blocks.emplace_back();
+	blocks[*index] = {b, size, 0};
+	
+	ranges.add_region(*index, size);
+	return true;
+}
+
+bool geometry_pool::allocate(void* vertices, uint32_t vertex_count, uint32_t* indices, uint32_t index_count, geometry_range* range)
+{
+	uint64_t vertex_size = (uint64_t) vertex_count * vertex_stride;
+	uint64_t index_size = (uint64_t) index_count * sizeof(uint32_t);
+	
+	uint64_t size, alignment;
+	get_request(vertex_size + index_size, &size, &alignment);
+	
+	tlsf_allocation allocation;
+	if(!ranges.allocate(size, alignment, &allocation))
+	{
+		//Meshes bigger than a block get a block of their own.
+		uint32_t index;
+		if(!add_block(std::max(block_size, size), &index)) return false;
+		if(!ranges.allocate_region(index, size, &allocation)) return false;
+	}
+	
+	uint64_t vertex_start = (allocation.offset + vertex_stride - 1) / vertex_stride * vertex_stride;
+	uint64_t index_start = vertex_start + vertex_size;
+	
+	alloc::buffer* b = &blocks[allocation.region].buffer;
+	if(!alloc::upload_to_buffer(b, vertex_start, vertices, vertex_size) || !alloc::upload_to_buffer(b, index_start, indices, index_size))
+	{
+		ranges.free(allocation.block);
+		return false;
+	}
+	
+	range->allocation = allocation.block;
+	range->block = allocation.region;
+	range->vertex_offset = vertex_start / vertex_stride;
+	range->first_index = index_start / sizeof(uint32_t);
+	
+	blocks[allocation.region].used_size += allocation.size;
+	set_allocation(allocation.block, {range, vertex_size + index_size, allocation.size});
+	
+	return true;
+}
+
+void geometry_pool::begin_draw()
+{
+	bound_block = TLSF_NONE;
+}
+
+void geometry_pool::bind(command_buffer* cmd_buffer, uint32_t block)
+{
+	if(block == bound_block) return;
+	
+	cmd_buffer->bind_vertex_buffer(blocks[block].buffer.vk_buffer, 0);
+	cmd_buffer->bind_index_buffer(blocks[block].buffer.vk_buffer, 0);
+	
+	bound_block = block;
+}
+
+void geometry_pool::choose_evacuated_block()
+{
+	//The emptiest block goes, as long as the others have room to spare for what's left in it. Their free space is split up, so twice as much is asked for.
+	uint32_t emptiest = TLSF_NONE;
+	uint32_t block_count = 0;
+	uint64_t free_size = 0;
+	
+	for(uint32_t i = 0; i < blocks.size(); i++)
+	{
+		if(blocks[i].size == 0) continue;
+		
+		block_count++;
+		free_size += blocks[i].size - blocks[i].used_size;
+		
+		if(emptiest == TLSF_NONE || blocks[i].used_size < blocks[emptiest].used_size) emptiest = i;
+	}
+	
+	if(block_count < 2) return;
+	
+	//Only blocks less than half full are worth emptying.
+	const block& b = blocks[emptiest];
+	if(b.used_size * 2 > b.size) return;
+	if(free_size - (b.size - b.used_size) < b.used_size * 2) return;
+	
+	evacuated_block = emptiest;
+}
+
+void geometry_pool::defragment(uint64_t max_bytes)
+{
+	frame++;
+	
+	//The copies recorded by the last call went out with the caller's upload batch since, so the token for everything submitted covers them.
+	uint64_t upload_token = alloc::get_upload_token();
+	
+	//Ranges that were freed or moved away from are given back once nothing can read them anymore.
+	for(size_t i = 0; i < retired.size(); i++)
+	{
+		retired_range& r = retired[i];
+		if(r.upload_token == GEOMETRY_POOL_UNSUBMITTED) r.upload_token = upload_token;
+		
+		if(frame < r.frame + GEOMETRY_POOL_RETIRE_FRAMES || !alloc::is_upload_done(r.upload_token)) continue;
+		
+		ranges.free(r.allocation);
+		blocks[r.block].used_size -= r.allocated_size;
+		
+		retired[i] = retired.back();
+		retired.pop_back();
+		i--;
+	}
+	
+	//Blocks can also be emptied by meshes being freed. One block is always kept.
+	uint32_t block_count = 0;
+	for(uint32_t i = 0; i < blocks.size(); i++)
+		if(blocks[i].size != 0) block_count++;
+	
+	for(uint32_t i = 0; i < blocks.size() && block_count > 1; i++)
+	{
+		if(blocks[i].size == 0 || blocks[i].used_size > 0 || i == evacuated_block) continue;
+		
+		release_block(i);
+		block_count--;
+	}
+	
+	if(evacuated_block == TLSF_NONE && frame >= next_evacuation_frame) choose_evacuated_block();
+	if(evacuated_block == TLSF_NONE) return;
+	
+	//Anything freed since the last call is sealed too.
+	ranges.allocate_free_blocks(evacuated_block, &sealed);
+	
+	std::vector<retired_range> moved;
+	bool stuck = false;
+	
+	uint64_t moved_size = 0;
+	for(uint32_t i = 0; i < allocations.size() && moved_size < max_bytes; i++)
+	{
+		if(allocations[i].range == nullptr || allocations[i].range->block != evacuated_block) continue;
+		
+		if(!move_range(i, &moved))
+		{
+			stuck = true;
+			break;
+		}
+		
+		moved_size += allocations[i].data_size;
+	}
+	
+	for(size_t i = 0; i < moved.size(); i++)
+	{
+		moved[i].upload_token = GEOMETRY_POOL_UNSUBMITTED;
+		moved[i].frame = frame;
+		retired.push_back(moved[i]);
+	}
+	
+	if(!stuck && blocks[evacuated_block].used_size > 0) return;
+	
+	//Either the block is empty, or the others ran out of room. Whatever was sealed is handed out again.
+	for(size_t i = 0; i < sealed.size(); i++)
+		ranges.free(sealed[i]);
+	
+	sealed.clear();
+	
+	//The ranges moved so far stay where they are, the block is just emptier.
+	if(stuck) next_evacuation_frame = frame + GEOMETRY_POOL_RETRY_FRAMES;
+	else if(block_count > 1) release_block(evacuated_block);
+	
+	evacuated_block = TLSF_NONE;
+}
+
+void geometry_pool::free(const geometry_range& range)
+{
+	allocation_info& info = allocations[range.allocation];
+	info.range = nullptr;
+	
+	//Retired like a range that was moved away from. It stays in used_size until defragment() gives it back.
+	retired.push_back({range.allocation, range.block, info.allocated_size, alloc::get_upload_token(), frame});
+}
+
+uint32_t geometry_pool::get_block_count() const
+{
+	uint32_t count = 0;
+	for(size_t i = 0; i < blocks.size(); i++)
+		if(blocks[i].size != 0) count++;
+	
+	return count;
+}
+
+//vertexOffset counts whole vertices, so vertices have to start on a multiple of the stride.
+//TLSF only aligns to powers of two, other strides get enough room to move the start up to the next multiple.
+void geometry_pool::get_request(uint64_t data_size, uint64_t* size, uint64_t* alignment) const
+{
+	bool power_of_two = (vertex_stride & (vertex_stride - 1)) == 0;
+	
+	*alignment = power_of_two ? vertex_stride : sizeof(uint32_t);
+	*size = data_size + (power_of_two ? 0 : vertex_stride - sizeof(uint32_t));
+}
+
+void geometry_pool::get_stats(memory_stats* stats) const
+{
+	ranges.get_stats(stats);
+}
+
+bool geometry_pool::move_range(uint32_t allocation, std::vector<retired_range>* moved)
+{
+	allocation_info info = allocations[allocation];
+	geometry_range* range = info.range;
+	
+	uint64_t size, alignment;
+	get_request(info.data_size, &size, &alignment);
+	
+	//The evacuated block is sealed, so this lands in another one or fails.
+	tlsf_allocation target;
+	if(!ranges.allocate(size, alignment, &target)) return false;
+	
+	uint64_t old_vertex_start = (uint64_t) range->vertex_offset * vertex_stride;
+	uint64_t vertex_start = (target.offset + vertex_stride - 1) / vertex_stride * vertex_stride;
+	
+	if(!alloc::copy_buffer_range(&blocks[range->block].buffer, old_vertex_start, &blocks[target.region].buffer, vertex_start, info.data_size))
+	{
+		ranges.free(target.block);
+		return false;
+	}
+	
+	moved->push_back({allocation, range->block, info.allocated_size, 0, 0});
+	allocations[allocation].range = nullptr;
+	
+	//Indices keep their place relative to the vertices.
+	uint64_t index_start = vertex_start + ((uint64_t) range->first_index * sizeof(uint32_t) - old_vertex_start);
+	
+	range->allocation = target.block;
+	range->block = target.region;
+	range->vertex_offset = vertex_start / vertex_stride;
+	range->first_index = index_start / sizeof(uint32_t);
+	
+	blocks[target.region].used_size += target.size;
+	set_allocation(target.block, {range, info.data_size, target.size});
+	
+	return true;
+}
+
+void geometry_pool::release_block(uint32_t index)
+{
+	ranges.remove_region(index);
+	
+	alloc::free(blocks[index].buffer);
+	blocks[index].size = 0;
+	
+#ifdef DEBUG_PRINT_SUCCESS
+	std::cout << "[UTILS|INF] Gave geometry block " << index << " back." << std::endl;
+#endif
+	
+	//The block's buffer may have been all that was left in its memory page.
+	alloc::release_empty_pages();
+}
+
+void geometry_pool::set_allocation(uint32_t allocation, const allocation_info& info)
+{
+	if(allocation >= allocations.size()) allocations.resize(allocation + 1, {nullptr, 0, 0});
+	allocations[allocation] = info;
+}
@@ -0,0 +1,127 @@
+#ifndef _GEOMETRY_POOL_H_
+#define _GEOMETRY_POOL_H_
+
+#include <vector>
+
+#include "alloc.h"
+#include "memory_stats.h"
+#include "tlsf.h"
+
+#include "../renderer/cmdbuffer.h"
+
+//Frames a range that was freed or moved away from stays allocated for, so frames still in flight can keep drawing from it. More than any swapchain has images.
+#define GEOMETRY_POOL_RETIRE_FRAMES 8
+
+//Upload token of ranges moved away from by copies that haven't been submitted yet.
+#define GEOMETRY_POOL_UNSUBMITTED UINT64_MAX
+
+//Frames to wait before trying again when the other blocks had no room for a range of the block being emptied.
+#define GEOMETRY_POOL_RETRY_FRAMES 120
+
+struct geometry_range
+{
+	//Handle to give back to geometry_pool::free().
+	uint32_t allocation;
+	
+	//Meshes in the same block are drawn without binding anything in between.
+	uint32_t block;
+	
+	//In vertices and indices, as vkCmdDrawIndexed() takes them.
+	uint32_t vertex_offset;
+	uint32_t first_index;
+};
+
+//Vertices and indices of many meshes, sub-allocated from a few big device local buffers (blocks) instead of two buffers per mesh.
+//Every mesh takes a single range of a block, its vertices followed by its indices. Blocks are added as needed, and given back once defragment() has emptied them.
+class geometry_pool
+{
+	public:
+		geometry_pool(uint32_t vertex_stride, uint64_t block_size);
+		~geometry_pool();
+		
+		//The vertices and indices are staged into the new range, inside the open upload batch if there's one.
+		//range is patched whenever defragment() moves the mesh, so it has to stay where it is until it's freed.
+		bool allocate(void* vertices, uint32_t vertex_count, uint32_t* indices, uint32_t index_count, geometry_range* range);
+		
+		//Forgets which block is bound. Call it before drawing into a command buffer.
+		void begin_draw();
+		
+		//Binds the block as both the vertex and the index buffer, unless it's already bound.
+		void bind(command_buffer* cmd_buffer, uint32_t block);
+		
+		//Call once a frame, inside an upload batch of its own. Moves up to max_bytes of meshes out of the emptiest block with GPU copies, and gives the block back once nothing is left in it.
+		//Nothing waits: moved meshes are drawn from their new range right away, their old one is freed once the copy is done and no frame in flight can be drawing from it.
+		void defragment(uint64_t max_bytes);
+		
+		//Doesn't wait. The range is given back by defragment() once uploads submitted until now are done and no frame in flight can be drawing from it.
+		void free(const geometry_range& range);
+		
+		uint32_t get_block_count() const;
+		void get_stats(memory_stats* stats) const;
+	private:
+		struct block
+		{
+			alloc::buffer buffer;
+			
+			//0 once the block was given back. Its index goes to the next block added.
+			uint64_t size;
+			
+			//Bytes taken up by ranges, including the ones that were moved away from but aren't freed yet.
+			uint64_t used_size;
+		};
+		
+		//By TLSF block handle.
+		struct allocation_info
+		{
+			//nullptr if the handle isn't a mesh's range.
+			geometry_range* range;
+			
+			//Vertices and indices, from the start of the vertices.
+			uint64_t data_size;
+			uint64_t allocated_size;
+		};
+		
+		struct retired_range
+		{
+			uint32_t allocation;
+			uint32_t block;
+			uint64_t allocated_size;
+			
+			uint64_t upload_token;
+			uint64_t frame;
+		};
+		
+		std::vector<block> blocks;
+		std::vector<allocation_info> allocations;
+		tlsf_allocator ranges;
+		
+		uint32_t vertex_stride;
+		uint64_t block_size;
+		
+		uint32_t bound_block;
+		
+		//Block being emptied by defragment(), TLSF_NONE if there's none. Its free space is kept allocated (sealed), so new meshes go elsewhere.
+		uint32_t evacuated_block;
+		std::vector<uint32_t> sealed;
+		
+		//No block is emptied before this frame, after one couldn't be.
+		uint64_t next_evacuation_frame;
+		
+		std::vector<retired_range> retired;
+		uint64_t frame;
+		
+		bool add_block(uint64_t size, uint32_t* index);
+		
+		void choose_evacuated_block();
+		
+		void get_request(uint64_t data_size, uint64_t* size, uint64_t* alignment) const;
+		
+		//Moves the range out of the evacuated block. The range it leaves is appended to moved.
+		bool move_range(uint32_t allocation, std::vector<retired_range>* moved);
+		
+		void release_block(uint32_t index);
+		
+		void set_allocation(uint32_t allocation, const allocation_info& info);
+};
+
+#endif
@@ -0,0 +1,66 @@
+#include "hash.h"
+
+#include <cstring>
+
+static uint32_t crc32_table[256];
+static bool crc32_table_built = false;
+
+static void build_crc32_table()
+{
+	for(uint32_t i = 0; i < 256; i++)
+	{
+		uint32_t c = i;
+		for(uint8_t j = 0; j < 8; j++)
+			c = (c & 1) ? (0xedb88320 ^ (c >> 1)) : (c >> 1);
+		crc32_table[i] = c;
+	}
+	
+	crc32_table_built = true;
+}
+
+uint32_t hash::crc32(const void* data, size_t size)
+{
+	//The table is deterministic, so a race between two threads building it at once is harmless.
+	if(!crc32_table_built) build_crc32_table();
+	
+	const uint8_t* bytes = (const uint8_t*) data;
+	uint32_t c = 0xffffffff;
+	
+	for(size_t i = 0; i < size; i++)
+		c = crc32_table[(c ^ bytes[i]) & 255] ^ (c >> 8);
+	
+	return c ^ 0xffffffff;
+}
+
+static uint64_t rotate_left(uint64_t value, uint8_t bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+
+uint64_t hash::hash64(const void* data, size_t size)
+{
+	const uint8_t* bytes = (const uint8_t*) data;
+	uint64_t h = 0x9e3779b97f4a7c15ull ^ size;
+	
+	size_t i = 0;
+	for(; i + 8 <= size; i += 8)
+	{
+		uint64_t word;
+		std::memcpy(&word, bytes + i, sizeof(word));
+		
+		h ^= rotate_left(word * 0x87c37b91114253d5ull, 31) * 0x4cf5ad432745937full;
+		h = rotate_left(h, 27) * 5 + 0x52dce729;
+	}
+	
+	for(; i < size; i++)
+		h = (h ^ bytes[i]) * 0x100000001b3ull;
+	
+	//Final avalanche, so every input bit affects every output bit.
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	
+	return h;
+}
@@ -0,0 +1,15 @@
+#ifndef _HASH_H_
+#define _HASH_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace hash
+{
+	uint32_t crc32(const void* data, size_t size);
+	
+	//Much faster than crc32() on large buffers, for content addressing. Equal hashes still have to be confirmed by comparing the data.
+	uint64_t hash64(const void* data, size_t size);
+}
+
+#endif
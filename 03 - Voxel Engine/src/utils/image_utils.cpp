@@ -210,7 +210,7 @@ bool utils::load_bmp_texture(const char* filepath, unsigned int* width, unsigned
 bool utils::read_pixel(alloc::image* image, uint32_t x, uint32_t y, void* data)
 {
 	uint8_t pixel_size = get_format_pixel_size(image->vk_format) >> 3;
-	VkDeviceMemory mem = alloc::get_memory_page(image->page_index);
+	uint8_t* mapping = (uint8_t*) alloc::get_page_mapping(image->page_index);
 
 	size_t pixel_offset = (x * image->height + y) * pixel_size;
 	if(pixel_offset > image->allocation_size)
@@ -221,37 +221,14 @@ bool utils::read_pixel(alloc::image* image, uint32_t x, uint32_t y, void* data)
 	
 	std::cout << image->page_offset << std::endl;
 	
-	void* map;
-	vkMapMemory(get_device(), mem, pixel_offset + image->page_offset, pixel_size, 0, &map);
-		memcpy(data, map, pixel_size);
-	vkUnmapMemory(get_device(), mem);
+	memcpy(data, mapping + image->page_offset + pixel_offset, pixel_size);
 	
 	return true;
 }
 
 bool utils::transition_image_layout(alloc::image* image, VkImageAspectFlags aspect, VkImageLayout old_layout, VkImageLayout new_layout)
-{
-    return transition_image_layout(image, alloc::get_staging_command_pool(), alloc::get_staging_queue(), aspect, old_layout, new_layout);
-}
-
-bool utils::transition_image_layout(alloc::image* image, VkCommandPool command_pool, VkQueue queue, VkImageAspectFlags aspect, VkImageLayout old_layout, VkImageLayout new_layout)
 {
 	VkFormat format = image->vk_format;
-    VkCommandBuffer command_buffer;
-    
-    VkCommandBufferAllocateInfo info_alloc{};
-    info_alloc.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    info_alloc.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    info_alloc.commandPool = command_pool;
-    info_alloc.commandBufferCount = 1;
-
-    vkAllocateCommandBuffers(get_device(), &info_alloc, &command_buffer);
-
-    VkCommandBufferBeginInfo info_begin{};
-    info_begin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    info_begin.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-    vkBeginCommandBuffer(command_buffer, &info_begin);
 
     VkImageMemoryBarrier barrier{};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -314,20 +291,10 @@ bool utils::transition_image_layout(alloc::image* image, VkCommandPool command_p
         return false;
     }
 
-    vkCmdPipelineBarrier(command_buffer, src_stage, dst_stage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-    vkEndCommandBuffer(command_buffer);
-
-    VkSubmitInfo info_submit{};
-    info_submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    info_submit.commandBufferCount = 1;
-    info_submit.pCommandBuffers = &command_buffer;
-
-    vkQueueSubmit(queue, 1, &info_submit, VK_NULL_HANDLE);
-    vkQueueWaitIdle(queue);
+    //Recorded with the uploads, so it runs in order with the copies around it.
+    vkCmdPipelineBarrier(alloc::record_upload_commands(), src_stage, dst_stage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
 	
 	image->vk_image_layout = new_layout;
 
-    vkFreeCommandBuffers(get_device(), command_pool, 1, &command_buffer);
-    return true;
+    return alloc::finish_upload_commands();
 }
\ No newline at end of file
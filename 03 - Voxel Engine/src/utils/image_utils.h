@@ -18,7 +18,6 @@ namespace utils
     bool load_bmp_texture(const char* filepath, unsigned int* width, unsigned int* height, unsigned int* channels, char** data);
 
     bool transition_image_layout(alloc::image* image, VkImageAspectFlags aspect, VkImageLayout old_layout, VkImageLayout new_layout);
-    bool transition_image_layout(alloc::image* image, VkCommandPool command_pool, VkQueue queue, VkImageAspectFlags aspect, VkImageLayout old_layout, VkImageLayout new_layout);
 	
 	bool read_pixel(alloc::image* image, uint32_t x, uint32_t y, void* data);
 }
@@ -0,0 +1,169 @@
+#include "mapped_file.h"
+
+#include <iostream>
+
+#ifdef _WIN32
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+mapped_file::mapped_file()
+{
+	data = nullptr;
+	size = 0;
+	
+#ifdef _WIN32
+	file_handle = INVALID_HANDLE_VALUE;
+	mapping_handle = nullptr;
+#else
+	fd = -1;
+#endif
+}
+
+mapped_file::~mapped_file()
+{
+	close();
+}
+
+void mapped_file::advise_will_need(size_t offset, size_t size)
+{
+	if(data == nullptr || offset >= this->size) return;
+	if(offset + size > this->size) size = this->size - offset;
+	
+#ifdef _WIN32
+	#if _WIN32_WINNT >= 0x0602
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = (void*) (data + offset);
+	range.NumberOfBytes = size;
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+	#endif
+#else
+	//madvise wants a page-aligned address.
+	size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+	size_t aligned_offset = offset - (offset % page_size);
+	
+	madvise((void*) (data + aligned_offset), size + (offset - aligned_offset), MADV_WILLNEED);
+#endif
+}
+
+void mapped_file::close()
+{
+#ifdef _WIN32
+	if(data != nullptr) UnmapViewOfFile(data);
+	if(mapping_handle != nullptr) CloseHandle(mapping_handle);
+	if(file_handle != INVALID_HANDLE_VALUE) CloseHandle(file_handle);
+	
+	mapping_handle = nullptr;
+	file_handle = INVALID_HANDLE_VALUE;
+#else
+	if(data != nullptr) munmap((void*) data, size);
+	if(fd != -1) ::close(fd);
+	
+	fd = -1;
+#endif
+	
+	data = nullptr;
+	size = 0;
+}
+
+void mapped_file::drop_page_cache()
+{
+	if(data == nullptr) return;
+	
+#ifndef _WIN32
+	madvise((void*) data, size, MADV_DONTNEED);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+}
+
+const uint8_t* mapped_file::get_data() const
+{
+	return data;
+}
+
+size_t mapped_file::get_size() const
+{
+	return size;
+}
+
+bool mapped_file::is_open() const
+{
+	return data != nullptr;
+}
+
+bool mapped_file::open(const std::string& path)
+{
+	close();
+	
+#ifdef _WIN32
+	file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+	if(file_handle == INVALID_HANDLE_VALUE)
+	{
+		std::cerr << "[UTILS|ERR] Failed to open file for mapping: " << path << std::endl;
+		return false;
+	}
+	
+	LARGE_INTEGER file_size;
+	if(!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+	
+	mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if(mapping_handle == nullptr)
+	{
+		std::cerr << "[UTILS|ERR] Failed to create file mapping: " << path << std::endl;
+		close();
+		return false;
+	}
+	
+	data = (const uint8_t*) MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+	if(data == nullptr)
+	{
+		std::cerr << "[UTILS|ERR] Failed to map view of file: " << path << std::endl;
+		close();
+		return false;
+	}
+	
+	size = (size_t) file_size.QuadPart;
+#else
+	fd = ::open(path.c_str(), O_RDONLY);
+	if(fd == -1)
+	{
+		std::cerr << "[UTILS|ERR] Failed to open file for mapping: " << path << std::endl;
+		return false;
+	}
+	
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		close();
+		return false;
+	}
+	
+	void* map = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if(map == MAP_FAILED)
+	{
+		std::cerr << "[UTILS|ERR] Failed to map file: " << path << std::endl;
+		close();
+		return false;
+	}
+	
+	data = (const uint8_t*) map;
+	size = (size_t) st.st_size;
+	
+	//Sector payloads are read in whatever order the camera asks for them, so the kernel's sequential readahead mostly wastes I/O.
+	//We issue our own hints via advise_will_need() instead.
+	madvise(map, size, MADV_RANDOM);
+#endif
+	
+	return true;
+}
@@ -0,0 +1,41 @@
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+//Read-only memory mapping of a whole file.
+class mapped_file
+{
+	public:
+		mapped_file();
+		~mapped_file();
+		
+		//Hints to the OS that [offset, offset + size) will be read soon, so it can start paging it in.
+		void advise_will_need(size_t offset, size_t size);
+		
+		void close();
+		
+		//Evicts the mapped pages from the page cache where the OS allows it. Only useful for measuring cold loads.
+		void drop_page_cache();
+		
+		const uint8_t* get_data() const;
+		size_t get_size() const;
+		
+		bool is_open() const;
+		
+		bool open(const std::string& path);
+	private:
+		const uint8_t* data;
+		size_t size;
+		
+	#ifdef _WIN32
+		void* file_handle;
+		void* mapping_handle;
+	#else
+		int fd;
+	#endif
+};
+
+#endif
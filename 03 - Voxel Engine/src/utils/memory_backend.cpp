@@ -0,0 +1,45 @@
+#include "memory_backend.h"
+
+host_memory_backend::host_memory_backend(bool backed) : backed(backed)
+{
+	allocated_size = 0;
+}
+
+bool host_memory_backend::allocate_page(uint32_t page, uint32_t /*memory_type*/, uint64_t size)
+{
+	if(page >= page_sizes.size())
+	{
+		page_sizes.resize(page + 1, 0);
+		page_data.resize(page + 1);
+	}
+	
+	if(backed)
+	{
+		page_data[page].reset(new (std::nothrow) uint8_t[size]);
+		if(!page_data[page]) return false;
+	}
+	
+	page_sizes[page] = size;
+	allocated_size += size;
+	
+	return true;
+}
+
+void host_memory_backend::free_page(uint32_t page)
+{
+	if(page >= page_sizes.size()) return;
+	
+	allocated_size -= page_sizes[page];
+	page_sizes[page] = 0;
+	page_data[page].reset();
+}
+
+uint64_t host_memory_backend::get_allocated_size() const
+{
+	return allocated_size;
+}
+
+uint8_t* host_memory_backend::get_page_data(uint32_t page) const
+{
+	return page < page_data.size() ? page_data[page].get() : nullptr;
+}
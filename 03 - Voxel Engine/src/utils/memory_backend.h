@@ -0,0 +1,41 @@
+#ifndef _MEMORY_BACKEND_H_
+#define _MEMORY_BACKEND_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+//Where page_allocator gets its pages from. alloc.cpp allocates device memory, host_memory_backend plain memory, so placement can be run and measured without a GPU.
+class memory_backend
+{
+	public:
+		virtual ~memory_backend() {}
+		
+		//page is the index the page will be known by from then on. Returns false if the memory couldn't be allocated.
+		virtual bool allocate_page(uint32_t page, uint32_t memory_type, uint64_t size) = 0;
+		virtual void free_page(uint32_t page) = 0;
+};
+
+//Stand-in for device memory. Unbacked pages only count bytes, backed ones are real memory that can be written to.
+class host_memory_backend : public memory_backend
+{
+	public:
+		host_memory_backend(bool backed);
+		
+		bool allocate_page(uint32_t page, uint32_t memory_type, uint64_t size) override;
+		void free_page(uint32_t page) override;
+		
+		uint64_t get_allocated_size() const;
+		
+		//nullptr for unbacked pages.
+		uint8_t* get_page_data(uint32_t page) const;
+	private:
+		bool backed;
+		uint64_t allocated_size;
+		
+		std::vector<uint64_t> page_sizes;
+		std::vector<std::unique_ptr<uint8_t[]> > page_data;
+};
+
+#endif
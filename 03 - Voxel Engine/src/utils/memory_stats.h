@@ -0,0 +1,51 @@
+#ifndef _MEMORY_STATS_H_
+#define _MEMORY_STATS_H_
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+//Filled in the same way by every sub-allocator, so they can be compared on the same allocations.
+struct memory_stats
+{
+	uint64_t capacity;
+	
+	//Bytes asked for, and bytes taken up by the allocations. The difference is lost to internal fragmentation (rounding up).
+	uint64_t requested_size;
+	uint64_t allocated_size;
+	
+	uint64_t free_size;
+	uint64_t largest_free_block;
+	
+	uint32_t allocation_count;
+	uint32_t free_block_count;
+};
+
+//A free or allocated block of a page, as listed in heap maps.
+struct memory_block
+{
+	uint64_t offset, size;
+	bool free;
+};
+
+//Share of the allocated bytes nobody asked for.
+inline double get_internal_fragmentation(const memory_stats& stats)
+{
+	return stats.allocated_size == 0 ? 0 : (double) (stats.allocated_size - stats.requested_size) / stats.allocated_size;
+}
+
+//Share of the free bytes that can't be handed out in one piece.
+inline double get_external_fragmentation(const memory_stats& stats)
+{
+	return stats.free_size == 0 ? 0 : 1 - (double) stats.largest_free_block / stats.free_size;
+}
+
+inline void print_memory_stats(const std::string& name, const memory_stats& stats)
+{
+	std::cout << "[UTILS|INF] " << name << ": " << stats.allocation_count << " allocations, " << stats.requested_size << " bytes requested, "
+		<< stats.allocated_size << " allocated, " << stats.free_size << " free of " << stats.capacity << " in " << stats.free_block_count << " blocks (largest "
+		<< stats.largest_free_block << "). Fragmentation: " << get_internal_fragmentation(stats) * 100 << "% internal, "
+		<< get_external_fragmentation(stats) * 100 << "% external." << std::endl;
+}
+
+#endif
@@ -2,12 +2,17 @@
 
 #include <iostream>
 
-mesh::mesh(pipeline_vertex_input pvi)
+mesh::mesh(pipeline_vertex_input pvi) : mesh(pvi, nullptr)
+{
+}
+
+mesh::mesh(pipeline_vertex_input pvi, geometry_pool* pool) : pool(pool)
 {
     data_per_vertex = pvi.vertex_binding.stride / sizeof(float);
 
     vb_created = false;
     ib_created = false;
+    range_allocated = false;
 
     built = false;
 }
@@ -52,11 +57,19 @@ bool mesh::build()
 
     if(data_vertices.size() > 0 && data_indices.size() > 0)
     {
-        if(!alloc::new_buffer(&vertex_buffer, data_vertices.data(), data_vertices.size() * sizeof(float), ALLOC_USAGE_STAGED_VERTEX_BUFFER)) return false;
-        vb_created = true;
-
-        if(!alloc::new_buffer(&index_buffer, data_indices.data(), data_indices.size() * sizeof(uint32_t), ALLOC_USAGE_STAGED_INDEX_BUFFER)) return false;
-        ib_created = true;
+        if(pool != nullptr)
+        {
+            if(!pool->allocate(data_vertices.data(), data_vertices.size() / data_per_vertex, data_indices.data(), data_indices.size(), &range)) return false;
+            range_allocated = true;
+        }
+        else
+        {
+            if(!alloc::new_buffer(&vertex_buffer, data_vertices.data(), data_vertices.size() * sizeof(float), ALLOC_USAGE_STAGED_VERTEX_BUFFER)) return false;
+            vb_created = true;
+
+            if(!alloc::new_buffer(&index_buffer, data_indices.data(), data_indices.size() * sizeof(uint32_t), ALLOC_USAGE_STAGED_INDEX_BUFFER)) return false;
+            ib_created = true;
+        }
 
         num_indices = data_indices.size();
 
@@ -75,15 +88,27 @@ void mesh::clear_buffers()
 {
     if(vb_created) alloc::free(vertex_buffer);
     if(ib_created) alloc::free(index_buffer);
+    if(range_allocated) pool->free(range);
 
     vb_created = false;
     ib_created = false;
+    range_allocated = false;
 
     built = false;
 }
 
 void mesh::draw(command_buffer* cmd_buffer)
 {
+    //Pooled meshes share their buffers, which are only bound when the previous mesh was in another block.
+    if(pool != nullptr)
+    {
+        if(!built) return;
+
+        pool->bind(cmd_buffer, range.block);
+        cmd_buffer->draw_indexed(num_indices, 1, range.first_index, range.vertex_offset, 0);
+        return;
+    }
+
     cmd_buffer->bind_vertex_buffer(vertex_buffer.vk_buffer, 0);
     cmd_buffer->bind_index_buffer(index_buffer.vk_buffer, 0);
 
@@ -2,6 +2,7 @@
 #define _MESH_H_
 
 #include "alloc.h"
+#include "geometry_pool.h"
 
 #include "../renderer/cmdbuffer.h"
 #include "../renderer/pipeline.h"
@@ -10,6 +11,9 @@ class mesh
 {
     public:
         mesh(pipeline_vertex_input pvi);
+
+        //The mesh is sub-allocated from the pool instead of getting buffers of its own.
+        mesh(pipeline_vertex_input pvi, geometry_pool* pool);
         ~mesh();
 
         void add_index(uint32_t index);
@@ -26,13 +30,16 @@ class mesh
         alloc::buffer vertex_buffer;
         alloc::buffer index_buffer;
 
+        geometry_pool* pool;
+        geometry_range range;
+
         std::vector<float> data_vertices;
         uint16_t data_per_vertex;
 
         std::vector<uint32_t> data_indices;
 
         size_t num_indices;
-        bool vb_created, ib_created, built;
+        bool vb_created, ib_created, range_allocated, built;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,286 @@
+#include "page_allocator.h"
+
+#include <iostream>
+
+page_allocator::page_allocator(memory_backend* backend, uint64_t page_size, uint8_t buddy_page_factor) : backend(backend), page_size(page_size), buddy_page_factor(buddy_page_factor)
+{
+	
+}
+
+bool page_allocator::allocate(uint32_t memory_type, uint64_t size, uint64_t alignment, bool buddy, page_allocation* allocation)
+{
+	if(memory_type >= PAGE_ALLOCATOR_MEMORY_TYPES) return false;
+	
+	uint64_t buddy_page_size = (uint64_t) 1 << buddy_page_factor;
+	if(buddy && size <= buddy_page_size && alignment <= buddy_page_size) return allocate_buddy(memory_type, size, alignment, allocation);
+	
+	tlsf_allocator& allocator = type_allocators[memory_type];
+	tlsf_allocation a;
+	uint32_t index;
+	
+	if(size >= page_size)
+	{
+		if(!create_page(memory_type, size, false, &index)) return false;
+	}
+	else if(!allocator.allocate(size, alignment, &a))
+	{
+	#ifdef DEBUG_ALLOC_PRINT
+		std::cout << "No page of memory type " << memory_type << " has enough space." << std::endl;
+	#endif
+		if(!create_page(memory_type, page_size, false, &index)) return false;
+	}
+	else
+	{
+		*allocation = {a.region, a.offset, a.size, a.block};
+		return true;
+	}
+	
+	//The new page is empty, and at least as big as the allocation.
+	if(!allocator.allocate_region(index, size, &a)) return false;
+	
+	*allocation = {a.region, a.offset, a.size, a.block};
+	return true;
+}
+
+//Buddy pages are looked through one by one, there are only ever a few of them.
+bool page_allocator::allocate_buddy(uint32_t memory_type, uint64_t size, uint64_t alignment, page_allocation* allocation)
+{
+	allocation->size = size;
+	allocation->block = TLSF_NONE;
+	
+	for(uint32_t i = 0; i < pages.size(); i++)
+	{
+		if(!pages[i].buddy || pages[i].memory_type != memory_type) continue;
+		
+		if(pages[i].buddy->allocate(size, alignment, &allocation->offset))
+		{
+			allocation->page = i;
+			return true;
+		}
+	}
+	
+	uint32_t index;
+	if(!create_page(memory_type, (uint64_t) 1 << buddy_page_factor, true, &index)) return false;
+	
+	allocation->page = index;
+	return pages[index].buddy->allocate(size, alignment, &allocation->offset);
+}
+
+bool page_allocator::create_page(uint32_t memory_type, uint64_t size, bool buddy, uint32_t* index)
+{
+	*index = pages.size();
+	for(uint32_t i = 0; i < pages.size(); i++)
+	{
+		if(pages[i].size == 0)
+		{
+			*index = i;
+			break;
+		}
+	}
+	
+	if(!backend->allocate_page(*index, memory_type, size)) return false;
+	
+	page p;
+	p.memory_type = memory_type;
+	p.size = size;
+	
+	if(buddy) p.buddy = std::make_shared<buddy_allocator>(buddy_page_factor);
+	else type_allocators[memory_type].add_region(*index, size);
+	
+	if(*index == pages.size()) pages.push_back(p);
+	else pages[*index] = p;
+	
+#ifdef DEBUG_ALLOC_PRINT
+	print_page(*index);
+#endif
+	return true;
+}
+
+void page_allocator::free(const page_allocation& allocation)
+{
+	if(allocation.page >= pages.size())
+	{
+		std::cerr << "[UTILS|ERR] Tried to free an allocation in page " << allocation.page << ", which doesn't exist." << std::endl;
+		return;
+	}
+	
+	//Merged with the free space around it right away.
+	if(pages[allocation.page].buddy) pages[allocation.page].buddy->free(allocation.offset);
+	else type_allocators[pages[allocation.page].memory_type].free(allocation.block);
+}
+
+void page_allocator::free_pages()
+{
+	for(uint32_t i = 0; i < pages.size(); i++)
+		if(pages[i].size != 0) backend->free_page(i);
+	
+	pages.clear();
+	
+	for(uint32_t i = 0; i < PAGE_ALLOCATOR_MEMORY_TYPES; i++)
+		type_allocators[i] = tlsf_allocator();
+}
+
+void page_allocator::get_buddy_page_stats(uint32_t page, memory_stats* stats) const
+{
+	*stats = {};
+	if(is_buddy_page(page)) pages[page].buddy->get_stats(stats);
+}
+
+void page_allocator::get_memory_type_stats(uint32_t memory_type, memory_stats* stats) const
+{
+	*stats = {};
+	if(memory_type < PAGE_ALLOCATOR_MEMORY_TYPES) type_allocators[memory_type].get_stats(stats);
+}
+
+uint32_t page_allocator::get_page_count() const
+{
+	return pages.size();
+}
+
+uint32_t page_allocator::get_page_memory_type(uint32_t page) const
+{
+	return pages[page].memory_type;
+}
+
+uint64_t page_allocator::get_page_size(uint32_t page) const
+{
+	return page < pages.size() ? pages[page].size : 0;
+}
+
+bool page_allocator::get_page_stats(uint32_t page, memory_stats* stats) const
+{
+	*stats = {};
+	if(page >= pages.size() || pages[page].size == 0) return false;
+	
+	if(pages[page].buddy) pages[page].buddy->get_stats(stats);
+	else type_allocators[pages[page].memory_type].get_region_stats(page, stats);
+	
+	return true;
+}
+
+void page_allocator::get_total_stats(memory_stats* stats) const
+{
+	*stats = {};
+	
+	auto add = [stats](const memory_stats& s)
+	{
+		stats->capacity += s.capacity;
+		stats->requested_size += s.requested_size;
+		stats->allocated_size += s.allocated_size;
+		stats->free_size += s.free_size;
+		stats->allocation_count += s.allocation_count;
+		stats->free_block_count += s.free_block_count;
+		
+		if(s.largest_free_block > stats->largest_free_block) stats->largest_free_block = s.largest_free_block;
+	};
+	
+	for(uint32_t i = 0; i < PAGE_ALLOCATOR_MEMORY_TYPES; i++)
+	{
+		memory_stats s;
+		type_allocators[i].get_stats(&s);
+		add(s);
+	}
+	
+	for(uint32_t i = 0; i < pages.size(); i++)
+	{
+		if(!pages[i].buddy) continue;
+		
+		memory_stats s;
+		pages[i].buddy->get_stats(&s);
+		add(s);
+	}
+}
+
+bool page_allocator::is_buddy_page(uint32_t page) const
+{
+	return page < pages.size() && pages[page].buddy;
+}
+
+void page_allocator::print_page(uint32_t page) const
+{
+	if(is_buddy_page(page))
+	{
+		memory_stats stats;
+		pages[page].buddy->get_stats(&stats);
+		print_memory_stats("Buddy page " + std::to_string(page), stats);
+		return;
+	}
+	
+	type_allocators[pages[page].memory_type].print_region(page);
+}
+
+void page_allocator::print_stats() const
+{
+	for(uint32_t i = 0; i < PAGE_ALLOCATOR_MEMORY_TYPES; i++)
+	{
+		memory_stats stats;
+		type_allocators[i].get_stats(&stats);
+		
+		if(stats.capacity > 0) print_memory_stats("Memory type " + std::to_string(i), stats);
+	}
+	
+	for(uint32_t i = 0; i < pages.size(); i++)
+		if(pages[i].buddy) print_page(i);
+}
+
+uint64_t page_allocator::release_empty_pages()
+{
+	uint64_t released = 0;
+	
+	for(uint32_t i = 0; i < pages.size(); i++)
+	{
+		if(pages[i].size == 0) continue;
+		
+		if(pages[i].buddy)
+		{
+			memory_stats stats;
+			pages[i].buddy->get_stats(&stats);
+			if(stats.allocation_count > 0) continue;
+			
+			pages[i].buddy.reset();
+		}
+		else
+		{
+			tlsf_allocator& allocator = type_allocators[pages[i].memory_type];
+			if(!allocator.is_region_free(i)) continue;
+			
+			allocator.remove_region(i);
+		}
+		
+		backend->free_page(i);
+		released += pages[i].size;
+		pages[i].size = 0;
+	}
+	
+	return released;
+}
+
+void page_allocator::write_heap_map(std::ostream& out) const
+{
+	out << "[";
+	
+	bool first = true;
+	std::vector<memory_block> blocks;
+	
+	for(uint32_t i = 0; i < pages.size(); i++)
+	{
+		memory_stats stats;
+		if(!get_page_stats(i, &stats)) continue;
+		
+		blocks.clear();
+		if(pages[i].buddy) pages[i].buddy->get_blocks(&blocks);
+		else type_allocators[pages[i].memory_type].get_region_blocks(i, &blocks);
+		
+		out << (first ? "\n" : ",\n") << "\t\t{\"page\": " << i << ", \"memory_type\": " << pages[i].memory_type << ", \"buddy\": " << (pages[i].buddy ? "true" : "false")
+			<< ", \"size\": " << pages[i].size << ", \"allocated\": " << stats.allocated_size << ", \"requested\": " << stats.requested_size
+			<< ", \"allocations\": " << stats.allocation_count << ", \"largest_free_block\": " << stats.largest_free_block << ", \"blocks\": [";
+		
+		for(size_t j = 0; j < blocks.size(); j++)
+			out << (j == 0 ? "" : ", ") << "[" << blocks[j].offset << ", " << blocks[j].size << ", " << (blocks[j].free ? "true" : "false") << "]";
+		
+		out << "]}";
+		first = false;
+	}
+	
+	out << (first ? "]" : "\n\t]");
+}
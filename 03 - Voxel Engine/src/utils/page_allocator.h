@@ -0,0 +1,92 @@
+#ifndef _PAGE_ALLOCATOR_H_
+#define _PAGE_ALLOCATOR_H_
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "buddy.h"
+#include "memory_backend.h"
+#include "memory_stats.h"
+#include "tlsf.h"
+
+//Same as VK_MAX_MEMORY_TYPES, without pulling Vulkan in.
+#define PAGE_ALLOCATOR_MEMORY_TYPES 32
+
+struct page_allocation
+{
+	uint32_t page;
+	uint64_t offset;
+	uint64_t size;
+	
+	//TLSF block, or TLSF_NONE for allocations in buddy pages.
+	uint32_t block;
+};
+
+//Decides where allocations go: pages of every memory type are regions of that type's TLSF allocator, allocations at least a page big get a page of their own,
+//and buddy allocations go to separate buddy pages. Pages come from the backend, nothing here touches Vulkan.
+class page_allocator
+{
+	public:
+		page_allocator(memory_backend* backend, uint64_t page_size, uint8_t buddy_page_factor);
+		
+		//alignment must be a power of two. Buddy allocations bigger than a buddy page are made like any other.
+		bool allocate(uint32_t memory_type, uint64_t size, uint64_t alignment, bool buddy, page_allocation* allocation);
+		
+		void free(const page_allocation& allocation);
+		
+		//Gives every page back to the backend.
+		void free_pages();
+		
+		uint32_t get_page_count() const;
+		uint32_t get_page_memory_type(uint32_t page) const;
+		
+		//0 for pages that were given back.
+		uint64_t get_page_size(uint32_t page) const;
+		
+		//How full a single page is, whichever allocator it belongs to. False for pages that were given back.
+		bool get_page_stats(uint32_t page, memory_stats* stats) const;
+		
+		//Stats of the TLSF pages of a memory type, or of a single buddy page.
+		void get_buddy_page_stats(uint32_t page, memory_stats* stats) const;
+		void get_memory_type_stats(uint32_t memory_type, memory_stats* stats) const;
+		
+		//Every memory type and buddy page added up. The largest free block is the largest of any page.
+		void get_total_stats(memory_stats* stats) const;
+		
+		bool is_buddy_page(uint32_t page) const;
+		
+		void print_page(uint32_t page) const;
+		void print_stats() const;
+		
+		//Gives pages with nothing allocated in them back to the backend. Returns how many bytes were given back.
+		uint64_t release_empty_pages();
+		
+		//Writes a JSON array with every page, its stats and its blocks as [offset, size, free]. Indented to be the value of a top level key.
+		void write_heap_map(std::ostream& out) const;
+	private:
+		struct page
+		{
+			uint32_t memory_type;
+			std::shared_ptr<buddy_allocator> buddy;
+			
+			//0 once the page was given back. Its index goes to the next page created.
+			uint64_t size;
+		};
+		
+		memory_backend* backend;
+		
+		uint64_t page_size;
+		uint8_t buddy_page_factor;
+		
+		std::vector<page> pages;
+		tlsf_allocator type_allocators[PAGE_ALLOCATOR_MEMORY_TYPES];
+		
+		bool allocate_buddy(uint32_t memory_type, uint64_t size, uint64_t alignment, page_allocation* allocation);
+		
+		bool create_page(uint32_t memory_type, uint64_t size, bool buddy, uint32_t* index);
+};
+
+#endif
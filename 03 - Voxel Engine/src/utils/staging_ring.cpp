@@ -0,0 +1,68 @@
+#include "staging_ring.h"
+
+staging_ring::staging_ring(uint64_t size) : size(size)
+{
+	head = 0;
+	used = 0;
+	open_size = 0;
+}
+
+void staging_ring::close_region(uint64_t serial)
+{
+	regions.push_back({open_size, serial});
+	open_size = 0;
+}
+
+uint64_t staging_ring::get_size() const
+{
+	return size;
+}
+
+uint64_t staging_ring::get_used_size() const
+{
+	return used;
+}
+
+void staging_ring::release(uint64_t completed_serial)
+{
+	while(!regions.empty() && regions.front().serial <= completed_serial)
+	{
+		used -= regions.front().size;
+		regions.pop_front();
+	}
+	
+	//Starting over at 0 keeps the next reservations from having to wrap.
+	if(used == 0) head = 0;
+}
+
+bool staging_ring::reserve(uint64_t bytes, uint64_t alignment, uint64_t* offset)
+{
+	if(alignment == 0) alignment = 1;
+	if(bytes > size || used == size) return false;
+	
+	//The free space is [head, tail), wrapping around the end of the ring if tail isn't past head.
+	uint64_t tail = (head + size - used) % size;
+	uint64_t aligned = (head + alignment - 1) & ~(alignment - 1);
+	uint64_t taken;
+	
+	if(used == 0 || head > tail)
+	{
+		if(aligned + bytes <= size) taken = aligned + bytes - head;
+		else if(bytes <= tail)
+		{
+			//The end of the ring is skipped, and belongs to this region until it's released.
+			taken = size - head + bytes;
+			aligned = 0;
+		}
+		else return false;
+	}
+	else if(aligned + bytes <= tail) taken = aligned + bytes - head;
+	else return false;
+	
+	head = (aligned + bytes) % size;
+	used += taken;
+	open_size += taken;
+	
+	*offset = aligned;
+	return true;
+}
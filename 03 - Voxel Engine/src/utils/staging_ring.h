@@ -0,0 +1,42 @@
+#ifndef _STAGING_RING_H_
+#define _STAGING_RING_H_
+
+#include <cstdint>
+#include <deque>
+
+//Hands out staging memory front to back, wrapping around to the start, so uploads can be written while earlier ones are still being copied.
+//Everything reserved between two close_region() calls is one region, given back once release() is called with its serial. Only offsets are handed out, like tlsf_allocator.
+class staging_ring
+{
+	public:
+		staging_ring(uint64_t size);
+		
+		//Closes the open region. serial must be higher than that of every region closed before.
+		void close_region(uint64_t serial);
+		
+		uint64_t get_size() const;
+		uint64_t get_used_size() const;
+		
+		//Gives back every closed region with a serial up to completed_serial.
+		void release(uint64_t completed_serial);
+		
+		//alignment must be a power of two. Returns false if there's no room until older regions are released.
+		bool reserve(uint64_t size, uint64_t alignment, uint64_t* offset);
+	private:
+		struct region
+		{
+			uint64_t size;
+			uint64_t serial;
+		};
+		
+		uint64_t size;
+		
+		//Where the next reservation starts, and how much is reserved behind it, padding included.
+		uint64_t head;
+		uint64_t used;
+		
+		uint64_t open_size;
+		std::deque<region> regions;
+};
+
+#endif
@@ -0,0 +1,417 @@
+#include "tlsf.h"
+
+#include <iostream>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+//Index of the highest set bit. value must not be 0.
+static uint32_t find_last_set(uint64_t value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return index;
+#else
+	return 63 - __builtin_clzll(value);
+#endif
+}
+
+//Index of the lowest set bit. value must not be 0.
+static uint32_t find_first_set(uint64_t value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, value);
+	return index;
+#else
+	return __builtin_ctzll(value);
+#endif
+}
+
+//Sizes below TLSF_SL_COUNT all go to the first level 0, one list per size. Above that, fl is the power of two range and sl the slice of it.
+static void get_mapping(uint64_t size, uint32_t* fl, uint32_t* sl)
+{
+	if(size < TLSF_SL_COUNT)
+	{
+		*fl = 0;
+		*sl = size;
+		return;
+	}
+	
+	uint32_t last = find_last_set(size);
+	*fl = last - TLSF_SL_LOG + 1;
+	*sl = (size >> (last - TLSF_SL_LOG)) - TLSF_SL_COUNT;
+}
+
+tlsf_allocator::tlsf_allocator()
+{
+	fl_bitmap = 0;
+	free_size = 0;
+	total_size = 0;
+	allocation_count = 0;
+	free_block_count = 0;
+	
+	for(uint32_t i = 0; i < TLSF_FL_COUNT; i++)
+	{
+		sl_bitmap[i] = 0;
+		for(uint32_t j = 0; j < TLSF_SL_COUNT; j++)
+			free_lists[i][j] = TLSF_NONE;
+	}
+}
+
+void tlsf_allocator::add_region(uint32_t region, uint64_t size)
+{
+	if(size == 0) return;
+	
+	if(region >= region_first.size()) region_first.resize(region + 1, TLSF_NONE);
+	
+	if(region_first[region] != TLSF_NONE)
+	{
+		std::cerr << "[UTILS|ERR] Region " << region << " was already added to the allocator." << std::endl;
+		return;
+	}
+	
+	uint32_t index = create_block(0, size, region);
+	region_first[region] = index;
+	
+	insert_free_block(index);
+	free_size += size;
+	total_size += size;
+}
+
+bool tlsf_allocator::allocate(uint64_t size, uint64_t alignment, tlsf_allocation* allocation)
+{
+	if(size == 0) size = 1;
+	if(alignment == 0) alignment = 1;
+	
+	uint32_t index = find_free_block(size, alignment);
+	if(index == TLSF_NONE) return false;
+	
+	remove_free_block(index);
+	take_block(index, size, alignment, allocation);
+	return true;
+}
+
+bool tlsf_allocator::allocate_region(uint32_t region, uint64_t size, tlsf_allocation* allocation)
+{
+	if(size == 0) size = 1;
+	if(!is_region_free(region) || blocks[region_first[region]].size < size) return false;
+	
+	uint32_t index = region_first[region];
+	
+	remove_free_block(index);
+	take_block(index, size, 1, allocation);
+	return true;
+}
+
+void tlsf_allocator::allocate_free_blocks(uint32_t region, std::vector<uint32_t>* free_blocks)
+{
+	if(region >= region_first.size()) return;
+	
+	for(uint32_t index = region_first[region]; index != TLSF_NONE; index = blocks[index].next_physical)
+	{
+		if(!blocks[index].free) continue;
+		
+		remove_free_block(index);
+		free_size -= blocks[index].size;
+		allocation_count++;
+		
+		free_blocks->push_back(index);
+	}
+}
+
+uint32_t tlsf_allocator::create_block(uint64_t offset, uint64_t size, uint32_t region)
+{
+	uint32_t index;
+	if(!unused_blocks.empty())
+	{
+		index = unused_blocks.back();
+		unused_blocks.pop_back();
+	}
+	else
+	{
+		index = blocks.size();
+		blocks.emplace_back();
+	}
+	
+	block& b = blocks[index];
+	
+	b.offset = offset;
+	b.size = size;
+	b.region = region;
+	b.prev_physical = TLSF_NONE;
+	b.next_physical = TLSF_NONE;
+	b.prev_free = TLSF_NONE;
+	b.next_free = TLSF_NONE;
+	b.free = false;
+	b.valid = true;
+	
+	return index;
+}
+
+void tlsf_allocator::destroy_block(uint32_t index)
+{
+	blocks[index].valid = false;
+	unused_blocks.push_back(index);
+}
+
+uint32_t tlsf_allocator::find_free_block(uint64_t size, uint64_t alignment)
+{
+	//Any block this big can hold the allocation, wherever the aligned offset ends up.
+	uint32_t fl, sl;
+	get_mapping(size + alignment - 1, &fl, &sl);
+	
+	//Every block in a list above the one size maps to is big enough, so no list has to be searched. Blocks that would just fit are left alone.
+	if(++sl == TLSF_SL_COUNT)
+	{
+		sl = 0;
+		fl++;
+	}
+	
+	if(fl >= TLSF_FL_COUNT) return TLSF_NONE;
+	
+	uint32_t sl_map = sl_bitmap[fl] & (~0u << sl);
+	if(sl_map == 0)
+	{
+		uint64_t fl_map = fl + 1 < 64 ? fl_bitmap & (~(uint64_t) 0 << (fl + 1)) : 0;
+		if(fl_map == 0) return TLSF_NONE;
+		
+		fl = find_first_set(fl_map);
+		sl_map = sl_bitmap[fl];
+	}
+	
+	return free_lists[fl][find_first_set(sl_map)];
+}
+
+void tlsf_allocator::free(uint32_t index)
+{
+	if(index >= blocks.size() || !blocks[index].valid || blocks[index].free)
+	{
+		std::cerr << "[UTILS|ERR] Tried to free block " << index << ", which isn't allocated." << std::endl;
+		return;
+	}
+	
+	free_size += blocks[index].size;
+	allocation_count--;
+	
+	uint32_t next = blocks[index].next_physical;
+	if(next != TLSF_NONE && blocks[next].free)
+	{
+		remove_free_block(next);
+		
+		blocks[index].size += blocks[next].size;
+		blocks[index].next_physical = blocks[next].next_physical;
+		if(blocks[next].next_physical != TLSF_NONE) blocks[blocks[next].next_physical].prev_physical = index;
+		
+		destroy_block(next);
+	}
+	
+	uint32_t prev = blocks[index].prev_physical;
+	if(prev != TLSF_NONE && blocks[prev].free)
+	{
+		remove_free_block(prev);
+		
+		blocks[prev].size += blocks[index].size;
+		blocks[prev].next_physical = blocks[index].next_physical;
+		if(blocks[index].next_physical != TLSF_NONE) blocks[blocks[index].next_physical].prev_physical = prev;
+		
+		destroy_block(index);
+		index = prev;
+	}
+	
+	insert_free_block(index);
+}
+
+uint64_t tlsf_allocator::get_free_size() const
+{
+	return free_size;
+}
+
+void tlsf_allocator::get_region_blocks(uint32_t region, std::vector<memory_block>* region_blocks) const
+{
+	if(region >= region_first.size()) return;
+	
+	for(uint32_t index = region_first[region]; index != TLSF_NONE; index = blocks[index].next_physical)
+		region_blocks->push_back({blocks[index].offset, blocks[index].size, blocks[index].free});
+}
+
+void tlsf_allocator::get_region_stats(uint32_t region, memory_stats* stats) const
+{
+	*stats = {};
+	if(region >= region_first.size()) return;
+	
+	for(uint32_t index = region_first[region]; index != TLSF_NONE; index = blocks[index].next_physical)
+	{
+		const block& b = blocks[index];
+		stats->capacity += b.size;
+		
+		if(b.free)
+		{
+			stats->free_size += b.size;
+			stats->free_block_count++;
+			if(b.size > stats->largest_free_block) stats->largest_free_block = b.size;
+		}
+		else
+		{
+			stats->allocated_size += b.size;
+			stats->allocation_count++;
+		}
+	}
+	
+	//Blocks are cut to the size asked for, nothing is rounded up.
+	stats->requested_size = stats->allocated_size;
+}
+
+void tlsf_allocator::get_stats(memory_stats* stats) const
+{
+	stats->capacity = total_size;
+	stats->requested_size = total_size - free_size;
+	stats->allocated_size = total_size - free_size;
+	stats->free_size = free_size;
+	stats->allocation_count = allocation_count;
+	stats->free_block_count = free_block_count;
+	
+	//The biggest free block is in the highest list that isn't empty, which has to be looked through.
+	stats->largest_free_block = 0;
+	if(fl_bitmap == 0) return;
+	
+	uint32_t fl = find_last_set(fl_bitmap);
+	uint32_t sl = find_last_set(sl_bitmap[fl]);
+	
+	for(uint32_t index = free_lists[fl][sl]; index != TLSF_NONE; index = blocks[index].next_free)
+		if(blocks[index].size > stats->largest_free_block) stats->largest_free_block = blocks[index].size;
+}
+
+bool tlsf_allocator::is_region_free(uint32_t region) const
+{
+	if(region >= region_first.size() || region_first[region] == TLSF_NONE) return false;
+	
+	//Free neighbours are always merged, so a free region is a single free block.
+	const block& first = blocks[region_first[region]];
+	return first.free && first.next_physical == TLSF_NONE;
+}
+
+void tlsf_allocator::insert_free_block(uint32_t index)
+{
+	uint32_t fl, sl;
+	get_mapping(blocks[index].size, &fl, &sl);
+	
+	uint32_t head = free_lists[fl][sl];
+	
+	blocks[index].free = true;
+	blocks[index].prev_free = TLSF_NONE;
+	blocks[index].next_free = head;
+	if(head != TLSF_NONE) blocks[head].prev_free = index;
+	
+	free_lists[fl][sl] = index;
+	fl_bitmap |= (uint64_t) 1 << fl;
+	sl_bitmap[fl] |= 1u << sl;
+	
+	free_block_count++;
+}
+
+void tlsf_allocator::print_region(uint32_t region) const
+{
+	std::cout << "[UTILS|INF] Free blocks in region " << region << ":" << std::endl;
+	
+	if(region < region_first.size())
+	{
+		for(uint32_t index = region_first[region]; index != TLSF_NONE; index = blocks[index].next_physical)
+			if(blocks[index].free) std::cout << "  [" << blocks[index].offset << ", " << blocks[index].size << "]" << std::endl;
+	}
+	
+	std::cout << "[UTILS|INF] End of free blocks." << std::endl;
+}
+
+void tlsf_allocator::remove_region(uint32_t region)
+{
+	if(!is_region_free(region))
+	{
+		std::cerr << "[UTILS|ERR] Tried to remove region " << region << ", which still has allocations." << std::endl;
+		return;
+	}
+	
+	uint32_t index = region_first[region];
+	
+	remove_free_block(index);
+	free_size -= blocks[index].size;
+	total_size -= blocks[index].size;
+	
+	destroy_block(index);
+	region_first[region] = TLSF_NONE;
+}
+
+void tlsf_allocator::remove_free_block(uint32_t index)
+{
+	block& b = blocks[index];
+	
+	if(b.prev_free != TLSF_NONE) blocks[b.prev_free].next_free = b.next_free;
+	if(b.next_free != TLSF_NONE) blocks[b.next_free].prev_free = b.prev_free;
+	
+	uint32_t fl, sl;
+	get_mapping(b.size, &fl, &sl);
+	
+	if(free_lists[fl][sl] == index)
+	{
+		free_lists[fl][sl] = b.next_free;
+		
+		if(b.next_free == TLSF_NONE)
+		{
+			sl_bitmap[fl] &= ~(1u << sl);
+			if(sl_bitmap[fl] == 0) fl_bitmap &= ~((uint64_t) 1 << fl);
+		}
+	}
+	
+	b.free = false;
+	b.prev_free = TLSF_NONE;
+	b.next_free = TLSF_NONE;
+	
+	free_block_count--;
+}
+
+uint32_t tlsf_allocator::split_block(uint32_t index, uint64_t size)
+{
+	//create_block() may move the blocks around, so nothing is held by reference across it.
+	uint32_t front = create_block(blocks[index].offset, size, blocks[index].region);
+	
+	uint32_t prev = blocks[index].prev_physical;
+	blocks[front].prev_physical = prev;
+	blocks[front].next_physical = index;
+	
+	if(prev != TLSF_NONE) blocks[prev].next_physical = front;
+	else region_first[blocks[index].region] = front;
+	
+	blocks[index].prev_physical = front;
+	blocks[index].offset += size;
+	blocks[index].size -= size;
+	
+	return front;
+}
+
+void tlsf_allocator::take_block(uint32_t index, uint64_t size, uint64_t alignment, tlsf_allocation* allocation)
+{
+	uint64_t padding = ((blocks[index].offset + alignment - 1) & ~(alignment - 1)) - blocks[index].offset;
+	if(padding > 0)
+	{
+		uint32_t front = split_block(index, padding);
+		insert_free_block(front);
+	}
+	
+	if(blocks[index].size > size)
+	{
+		uint32_t taken = split_block(index, size);
+		insert_free_block(index);
+		index = taken;
+	}
+	
+	blocks[index].free = false;
+	free_size -= size;
+	allocation_count++;
+	
+	allocation->block = index;
+	allocation->region = blocks[index].region;
+	allocation->offset = blocks[index].offset;
+	allocation->size = size;
+}
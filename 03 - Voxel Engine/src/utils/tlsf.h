@@ -0,0 +1,114 @@
+#ifndef _TLSF_H_
+#define _TLSF_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "memory_stats.h"
+
+//Every power of two size range is split into (1 << TLSF_SL_LOG) free lists.
+#define TLSF_SL_LOG 4
+#define TLSF_SL_COUNT (1<<TLSF_SL_LOG)
+#define TLSF_FL_COUNT (64 - TLSF_SL_LOG + 1)
+
+#define TLSF_NONE UINT32_MAX
+
+struct tlsf_allocation
+{
+	//Handle to give back to tlsf_allocator::free().
+	uint32_t block;
+	
+	uint32_t region;
+	uint64_t offset;
+	uint64_t size;
+};
+
+//Two-level segregated fit allocator. Allocating and freeing take constant time, and freed blocks are merged with their free neighbours right away.
+//Only offsets are handed out, all bookkeeping lives on the host, so it works just as well for device memory that can't be written to.
+class tlsf_allocator
+{
+	public:
+		tlsf_allocator();
+		
+		//Makes (region, [0, size)) available. Blocks never span two regions.
+		void add_region(uint32_t region, uint64_t size);
+		
+		//alignment must be a power of two. Only lists whose every block fits are looked at, so this can return false even though a block in the list
+		//the size maps to would have fit. Returns false if no free block is big enough.
+		bool allocate(uint64_t size, uint64_t alignment, tlsf_allocation* allocation);
+		
+		//Allocates the start of a region with nothing allocated in it, e.g. one just added for a single allocation. Offset 0 suits any alignment.
+		bool allocate_region(uint32_t region, uint64_t size, tlsf_allocation* allocation);
+		
+		//Allocates every free block of the region as it is, which keeps other allocations out of it until they're freed. Their handles are appended to free_blocks.
+		void allocate_free_blocks(uint32_t region, std::vector<uint32_t>* free_blocks);
+		
+		void free(uint32_t block);
+		
+		uint64_t get_free_size() const;
+		
+		//Appends every block of the region, free or not, in order.
+		void get_region_blocks(uint32_t region, std::vector<memory_block>* region_blocks) const;
+		
+		//Like get_stats(), for a single region. Walks all of its blocks.
+		void get_region_stats(uint32_t region, memory_stats* stats) const;
+		
+		void get_stats(memory_stats* stats) const;
+		
+		//Whether nothing is allocated in the region.
+		bool is_region_free(uint32_t region) const;
+		
+		void print_region(uint32_t region) const;
+		
+		//Only for regions with nothing allocated. The region can be added again afterwards.
+		void remove_region(uint32_t region);
+	private:
+		struct block
+		{
+			uint64_t offset, size;
+			uint32_t region;
+			
+			//Neighbours in memory, within the same region.
+			uint32_t prev_physical, next_physical;
+			
+			//Neighbours in the free list, only while free.
+			uint32_t prev_free, next_free;
+			
+			bool free;
+			
+			//False once the block was merged into a neighbour (or its region removed), so freeing its handle again is caught.
+			bool valid;
+		};
+		
+		std::vector<block> blocks;
+		std::vector<uint32_t> unused_blocks;
+		
+		//First block of every region, by region.
+		std::vector<uint32_t> region_first;
+		
+		uint64_t fl_bitmap;
+		uint32_t sl_bitmap[TLSF_FL_COUNT];
+		uint32_t free_lists[TLSF_FL_COUNT][TLSF_SL_COUNT];
+		
+		uint64_t free_size;
+		uint64_t total_size;
+		uint32_t allocation_count;
+		uint32_t free_block_count;
+		
+		uint32_t create_block(uint64_t offset, uint64_t size, uint32_t region);
+		void destroy_block(uint32_t index);
+		
+		uint32_t find_free_block(uint64_t size, uint64_t alignment);
+		
+		void insert_free_block(uint32_t index);
+		void remove_free_block(uint32_t index);
+		
+		//Splits the padding and the rest off a block taken out of the free lists, and hands out what's left.
+		void take_block(uint32_t index, uint64_t size, uint64_t alignment, tlsf_allocation* allocation);
+		
+		//Cuts the start of the block off into a new block, which is returned. The given block keeps the rest.
+		uint32_t split_block(uint32_t index, uint64_t size);
+};
+
+#endif
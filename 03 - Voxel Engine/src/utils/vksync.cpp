@@ -55,6 +55,12 @@ VkFence fence::get_handle() const
 	return vk_fence;
 }
 
+bool fence::is_signaled() const
+{
+	if(!usable) return true;
+	return vkGetFenceStatus(get_device(), vk_fence) == VK_SUCCESS;
+}
+
 void fence::reset()
 {
 	if(!usable) return;
@@ -12,6 +12,9 @@ class fence
 		
 		VkFence get_handle() const;
 		
+		//Doesn't wait.
+		bool is_signaled() const;
+		
 		void reset();
 		void wait();
 	private:
@@ -0,0 +1,86 @@
+#include "brick.h"
+
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "../utils/hash.h"
+
+//Keyed by content hash. Entries only hold weak references, so a brick goes away with the last sector (or snapshot) using it.
+static std::unordered_multimap<uint64_t, std::weak_ptr<const voxel_brick> > bricks;
+static std::mutex bricks_lock;
+
+static uint8_t get_occupancy(const uint32_t* voxels)
+{
+	for(uint32_t i = 1; i < BRICK_VOLUME; i++)
+		if(voxels[i] != voxels[0]) return BRICK_MIXED;
+	
+	return voxels[0] == 0 ? BRICK_EMPTY : BRICK_FULL;
+}
+
+static void release_brick(uint64_t hash, const voxel_brick* b)
+{
+	{
+		std::lock_guard<std::mutex> guard(bricks_lock);
+		
+		//Only remove one expired entry (ours), another brick may share the hash.
+		auto range = bricks.equal_range(hash);
+		for(auto it = range.first; it != range.second; it++)
+		{
+			if(it->second.expired())
+			{
+				bricks.erase(it);
+				break;
+			}
+		}
+	}
+	
+	delete b;
+}
+
+void brick::get_stats(size_t* brick_count, size_t* reference_count)
+{
+	std::lock_guard<std::mutex> guard(bricks_lock);
+	
+	*brick_count = 0;
+	*reference_count = 0;
+	
+	for(auto& it : bricks)
+	{
+		long references = it.second.use_count();
+		if(references == 0) continue;
+		
+		(*brick_count)++;
+		*reference_count += references;
+	}
+}
+
+brick_ref brick::intern(const uint32_t* voxels)
+{
+	uint64_t hash = hash::hash64(voxels, BRICK_VOLUME * sizeof(uint32_t));
+	
+	//If one of these turns out to be the last reference, releasing it takes bricks_lock, so they may only go after the guard.
+	std::vector<brick_ref> candidates;
+	
+	std::lock_guard<std::mutex> guard(bricks_lock);
+	
+	auto range = bricks.equal_range(hash);
+	for(auto it = range.first; it != range.second; it++)
+	{
+		brick_ref b = it->second.lock();
+		if(b == nullptr) continue;
+		
+		candidates.push_back(b);
+		if(std::memcmp(b->voxels, voxels, BRICK_VOLUME * sizeof(uint32_t)) == 0) return b;
+	}
+	
+	voxel_brick* created = new voxel_brick;
+	std::memcpy(created->voxels, voxels, BRICK_VOLUME * sizeof(uint32_t));
+	created->occupancy = get_occupancy(voxels);
+	
+	brick_ref b(created, [hash](const voxel_brick* released) { release_brick(hash, released); });
+	bricks.emplace(hash, b);
+	
+	return b;
+}
@@ -0,0 +1,38 @@
+#ifndef _BRICK_H_
+#define _BRICK_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#define BRICK_FACTOR 3
+#define BRICK_SIZE (1<<BRICK_FACTOR)
+#define BRICK_VOLUME (BRICK_SIZE * BRICK_SIZE * BRICK_SIZE)
+
+//Every voxel is 0, every voxel holds the same non-zero value, or anything else.
+#define BRICK_EMPTY 0
+#define BRICK_FULL 1
+#define BRICK_MIXED 2
+
+//Bricks are never written to once created, so they can be shared between sectors and mesh snapshots. Writers copy them instead.
+struct voxel_brick
+{
+	//[x][y][z], same order as within a sector.
+	uint32_t voxels[BRICK_VOLUME];
+	
+	//BRICK_EMPTY, BRICK_FULL or BRICK_MIXED. Lets meshing skip over uniform bricks without looking at their voxels.
+	uint8_t occupancy;
+};
+
+typedef std::shared_ptr<const voxel_brick> brick_ref;
+
+namespace brick
+{
+	//Number of distinct interned bricks alive, and how many references point at them in total.
+	void get_stats(size_t* brick_count, size_t* reference_count);
+
+	//Returns the interned brick holding the same voxels, or a new one if there is none yet. Thread safe.
+	brick_ref intern(const uint32_t* voxels);
+}
+
+#endif
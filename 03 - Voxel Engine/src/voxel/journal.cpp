@@ -0,0 +1,312 @@
+#include "journal.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "region.h"
+#include "sector.h"
+#include "../ref.h"
+#include "../utils/durable_file.h"
+#include "../utils/hash.h"
+
+#define JOURNAL_FILE "edits.vxj"
+
+#define JOURNAL_MAGIC 0x4A525856
+#define JOURNAL_VERSION 1
+#define JOURNAL_BATCH_MAGIC 0x42525856
+
+struct journal_header
+{
+	uint32_t magic;
+	uint32_t version;
+};
+
+//Every batch is checksummed, so a batch that was only partially written when we died is recognized and dropped on recovery.
+struct journal_batch_header
+{
+	uint32_t magic;
+	uint32_t count;
+	uint32_t checksum;
+	uint32_t reserved;
+};
+
+struct journal_record
+{
+	int64_t x, y, z;
+	uint32_t voxel_code;
+	uint32_t value;
+};
+
+typedef std::tuple<int64_t, int64_t, int64_t> sector_key;
+
+//Latest value of every voxel edited since the journal was last compacted, per sector.
+typedef std::map<sector_key, std::map<uint32_t, uint32_t> > edit_map;
+
+static std::string journal_path;
+static durable_file journal_file;
+
+static edit_map live_edits;
+
+static std::vector<journal_record> pending_records;
+static std::mutex pending_lock;
+static std::condition_variable pending_cv;
+
+static std::thread journal_thread;
+static bool journal_running = false;
+
+static void add_records(edit_map& edits, const journal_record* records, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+		edits[std::make_tuple(records[i].x, records[i].y, records[i].z)][records[i].voxel_code] = records[i].value;
+}
+
+static std::vector<uint32_t> flatten_edits(const std::map<uint32_t, uint32_t>& edits)
+{
+	std::vector<uint32_t> data;
+	data.reserve(edits.size() * 2);
+
+	for(auto& it : edits)
+	{
+		data.push_back(it.first);
+		data.push_back(it.second);
+	}
+
+	return data;
+}
+
+//Applies the edits on top of whatever the region files (or the region save queue) hold for each sector.
+static void replay_edits(const edit_map& edits)
+{
+	std::vector<uint32_t> voxels(SECTOR_VOLUME);
+	std::vector<uint32_t> saved_edits;
+
+	for(auto& it : edits)
+	{
+		int64_t x = std::get<0>(it.first);
+		int64_t y = std::get<1>(it.first);
+		int64_t z = std::get<2>(it.first);
+
+		saved_edits.clear();
+
+		switch(region::load_sector(x, y, z, voxels.data(), voxels.size(), &saved_edits))
+		{
+			case REGION_LOAD_VOXELS:
+				for(auto& edit : it.second)
+					if(edit.first < SECTOR_VOLUME) voxels[edit.first] = edit.second;
+
+				region::queue_save_sector(x, y, z, voxels);
+				break;
+			case REGION_LOAD_EDITS:
+			{
+				std::map<uint32_t, uint32_t> merged;
+				for(size_t i = 0; i + 1 < saved_edits.size(); i += 2)
+					merged[saved_edits[i]] = saved_edits[i + 1];
+				for(auto& edit : it.second)
+					merged[edit.first] = edit.second;
+
+				region::queue_save_sector_edits(x, y, z, flatten_edits(merged));
+				break;
+			}
+			default:
+				//Never saved, so the sector is just the generated terrain plus these edits.
+				region::queue_save_sector_edits(x, y, z, flatten_edits(it.second));
+				break;
+		}
+	}
+}
+
+static bool write_batch(const std::vector<journal_record>& records)
+{
+	journal_batch_header header{};
+	header.magic = JOURNAL_BATCH_MAGIC;
+	header.count = (uint32_t) records.size();
+	header.checksum = hash::crc32(records.data(), records.size() * sizeof(journal_record));
+
+	std::vector<uint8_t> buffer(sizeof(header) + records.size() * sizeof(journal_record));
+	std::memcpy(buffer.data(), &header, sizeof(header));
+	std::memcpy(buffer.data() + sizeof(header), records.data(), records.size() * sizeof(journal_record));
+
+	if(!journal_file.append(buffer.data(), buffer.size()) || !journal_file.sync())
+	{
+		std::cerr << "[VOX|ERR] Failed to write " << records.size() << " edits to the journal." << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+//Once the region files are synced, nothing in the journal is needed anymore.
+static void compact()
+{
+	if(!live_edits.empty())
+	{
+		replay_edits(live_edits);
+		if(!region::sync()) return;
+
+		live_edits.clear();
+	}
+
+	if(journal_file.get_size() > sizeof(journal_header) && !journal_file.truncate(sizeof(journal_header)))
+		std::cerr << "[VOX|ERR] Failed to truncate " << journal_path << "." << std::endl;
+}
+
+static void journal_thread_loop()
+{
+	std::unique_lock<std::mutex> lock(pending_lock);
+
+	while(true)
+	{
+		pending_cv.wait_for(lock, std::chrono::milliseconds(JOURNAL_FLUSH_INTERVAL_MS), []{ return !journal_running; });
+		bool stopping = !journal_running;
+
+		std::vector<journal_record> batch;
+		batch.swap(pending_records);
+
+		lock.unlock();
+
+		//Even if the write failed, the edits are still replayed at the next compaction.
+		if(!batch.empty())
+		{
+			write_batch(batch);
+			add_records(live_edits, batch.data(), batch.size());
+		}
+
+		if(stopping || journal_file.get_size() >= JOURNAL_COMPACT_SIZE) compact();
+
+		lock.lock();
+
+		if(stopping) break;
+	}
+}
+
+//Reads back every intact batch. Returns the number of edits recovered.
+static size_t recover(edit_map& edits)
+{
+	std::ifstream in(journal_path, std::ios::binary);
+	if(!in.is_open()) return 0;
+
+	std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	if(data.size() < sizeof(journal_header)) return 0;
+
+	journal_header header;
+	std::memcpy(&header, data.data(), sizeof(header));
+	if(header.magic != JOURNAL_MAGIC || header.version != JOURNAL_VERSION)
+	{
+		std::cerr << "[VOX|ERR] " << journal_path << " is corrupt or from an incompatible version, its edits are lost." << std::endl;
+		return 0;
+	}
+
+	size_t offset = sizeof(header);
+	size_t recovered = 0;
+
+	while(offset + sizeof(journal_batch_header) <= data.size())
+	{
+		journal_batch_header batch;
+		std::memcpy(&batch, data.data() + offset, sizeof(batch));
+
+		size_t records_size = (size_t) batch.count * sizeof(journal_record);
+		if(batch.magic != JOURNAL_BATCH_MAGIC || offset + sizeof(batch) + records_size > data.size()) break;
+
+		const uint8_t* records = data.data() + offset + sizeof(batch);
+		if(hash::crc32(records, records_size) != batch.checksum) break;
+
+		std::vector<journal_record> batch_records(batch.count);
+		std::memcpy(batch_records.data(), records, records_size);
+		add_records(edits, batch_records.data(), batch_records.size());
+
+		recovered += batch.count;
+		offset += sizeof(batch) + records_size;
+	}
+
+	if(offset != data.size())
+		std::cerr << "[VOX|WRN] Dropped " << (data.size() - offset) << " bytes of incomplete edits at the end of " << journal_path << "." << std::endl;
+
+	return recovered;
+}
+
+void journal::deinit()
+{
+	{
+		std::lock_guard<std::mutex> guard(pending_lock);
+		journal_running = false;
+	}
+	pending_cv.notify_all();
+
+	if(journal_thread.joinable()) journal_thread.join();
+
+	journal_file.close();
+}
+
+bool journal::init(const std::string& directory)
+{
+	journal_path = directory + JOURNAL_FILE;
+
+	edit_map recovered_edits;
+	size_t recovered = recover(recovered_edits);
+
+	if(recovered > 0)
+	{
+		INFO_LOG("Replaying " << recovered << " journaled edits in " << recovered_edits.size() << " sectors.");
+
+		replay_edits(recovered_edits);
+		if(!region::sync())
+		{
+			std::cerr << "[VOX|ERR] Failed to replay " << journal_path << ", edits made in this session won't be journaled." << std::endl;
+			return false;
+		}
+	}
+
+	if(!journal_file.open(journal_path)) return false;
+
+	//Everything in there has been replayed (or was unreadable), so start over with an empty journal.
+	if(!journal_file.truncate(0))
+	{
+		std::cerr << "[VOX|ERR] Failed to reset " << journal_path << "." << std::endl;
+		journal_file.close();
+		return false;
+	}
+
+	journal_header header;
+	header.magic = JOURNAL_MAGIC;
+	header.version = JOURNAL_VERSION;
+
+	if(!journal_file.append(&header, sizeof(header)) || !journal_file.sync())
+	{
+		std::cerr << "[VOX|ERR] Failed to write " << journal_path << "." << std::endl;
+		journal_file.close();
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(pending_lock);
+		journal_running = true;
+	}
+	journal_thread = std::thread(journal_thread_loop);
+
+	return true;
+}
+
+void journal::log_edit(int64_t x, int64_t y, int64_t z, uint32_t voxel_code, uint32_t value)
+{
+	journal_record record;
+	record.x = x;
+	record.y = y;
+	record.z = z;
+	record.voxel_code = voxel_code;
+	record.value = value;
+
+	//Checked under the lock, so no edit is queued after deinit() stopped the journal thread.
+	std::lock_guard<std::mutex> guard(pending_lock);
+	if(!journal_running) return;
+
+	pending_records.push_back(record);
+}
@@ -0,0 +1,25 @@
+#ifndef _JOURNAL_H_
+#define _JOURNAL_H_
+
+#include <cstdint>
+#include <string>
+
+//Edits are collected in memory and written to the journal as one batch (one write, one sync) per interval.
+#define JOURNAL_FLUSH_INTERVAL_MS 50
+
+//Once the journal grows past this, its edits are replayed into the region files and it starts over.
+#define JOURNAL_COMPACT_SIZE (1 << 20)
+
+namespace journal
+{
+	//Writes the last batch, replays everything into the region files and stops the journal thread. Call before region::deinit().
+	void deinit();
+
+	//Call after region::init(). Edits left behind by a previous run that didn't shut down cleanly are replayed into the region files first.
+	bool init(const std::string& directory);
+
+	//Only touches memory, so it's fine to call for every edit. The edit is durable once the next batch is written.
+	void log_edit(int64_t x, int64_t y, int64_t z, uint32_t voxel_code, uint32_t value);
+}
+
+#endif
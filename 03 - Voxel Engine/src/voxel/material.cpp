@@ -0,0 +1,55 @@
+#include "material.h"
+
+#include <iostream>
+
+static material_table table;
+static std::string names[MATERIAL_MAX_COUNT];
+static uint32_t count = 0;
+
+uint32_t material::get_count()
+{
+	return count;
+}
+
+const std::string& material::get_name(uint32_t id)
+{
+	return names[id & MATERIAL_ID_MASK];
+}
+
+const material_table& material::get_table()
+{
+	return table;
+}
+
+void material::init()
+{
+	if(count > 0) return;
+	
+	//Registered in the order of the MATERIAL_* ids.
+	register_material("air", false, false, 0, 0, 0, 0, 0);
+	register_material("grass", true, false, 0, 0.27, 0.9, 0.2, 0);
+	register_material("stone", true, false, 0, 0.5, 0.5, 0.52, 1);
+	register_material("glass", false, true, 0, 0.8, 0.9, 0.95, 2);
+}
+
+uint32_t material::register_material(const std::string& name, bool opaque, bool transparent, float emissive, float r, float g, float b, uint16_t texture_layer)
+{
+	if(count >= MATERIAL_MAX_COUNT)
+	{
+		std::cerr << "[VOX|ERR] Can't register material \"" << name << "\", the material table is full." << std::endl;
+		return MATERIAL_MAX_COUNT;
+	}
+	
+	uint32_t id = count++;
+	
+	table.opaque[id] = opaque;
+	table.transparent[id] = transparent;
+	table.emissive[id] = emissive;
+	table.color[id][0] = r;
+	table.color[id][1] = g;
+	table.color[id][2] = b;
+	table.texture_layer[id] = texture_layer;
+	names[id] = name;
+	
+	return id;
+}
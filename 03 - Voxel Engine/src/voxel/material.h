@@ -0,0 +1,41 @@
+#ifndef _MATERIAL_H_
+#define _MATERIAL_H_
+
+#include <cstdint>
+#include <string>
+
+//Voxel values are material ids, indexing the tables below. 0 is always air.
+#define MATERIAL_MAX_COUNT 256
+#define MATERIAL_ID_MASK (MATERIAL_MAX_COUNT - 1)
+
+#define MATERIAL_AIR 0
+#define MATERIAL_GRASS 1
+#define MATERIAL_STONE 2
+#define MATERIAL_GLASS 3
+
+//One array per property, so loops over voxels only pull in the properties they actually use.
+struct material_table
+{
+	//Hides the faces of whatever is next to it.
+	bool opaque[MATERIAL_MAX_COUNT];
+	bool transparent[MATERIAL_MAX_COUNT];
+	
+	float emissive[MATERIAL_MAX_COUNT];
+	float color[MATERIAL_MAX_COUNT][3];
+	uint16_t texture_layer[MATERIAL_MAX_COUNT];
+};
+
+namespace material
+{
+	uint32_t get_count();
+	const std::string& get_name(uint32_t id);
+	const material_table& get_table();
+	
+	//Registers the built-in materials. Must be called before any sector is generated, loaded or meshed.
+	void init();
+	
+	//Returns the id of the new material, or MATERIAL_MAX_COUNT if the table is full. Not thread safe, register everything up front.
+	uint32_t register_material(const std::string& name, bool opaque, bool transparent, float emissive, float r, float g, float b, uint16_t texture_layer);
+}
+
+#endif
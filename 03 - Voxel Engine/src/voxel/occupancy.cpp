@@ -0,0 +1,224 @@
+#include "occupancy.h"
+
+#include <algorithm>
+#include <cmath>
+
+//Nudges a ray past the boundary of the cell it just left, so it lands in the next one.
+#define OCCUPANCY_RAY_EPSILON 1e-4f
+
+occupancy_pyramid::occupancy_pyramid(uint8_t factor) : factor(factor)
+{
+	levels.resize(factor);
+	for(uint8_t l = 1; l <= factor; l++)
+	{
+		uint32_t side = 1 << (factor - l);
+		levels[l - 1].resize((side * side * side + 63) / 64, 0);
+	}
+}
+
+void occupancy_pyramid::build(const uint32_t* voxels)
+{
+	uint32_t size = 1 << factor;
+	uint32_t side = size >> 1;
+	
+	for(uint16_t i = 0; i < side; i++)
+	for(uint16_t j = 0; j < side; j++)
+	for(uint16_t k = 0; k < side; k++)
+	{
+		bool occupied = false;
+		for(uint32_t c = 0; c < 8 && !occupied; c++)
+		{
+			uint32_t x = (i << 1) | (c >> 2);
+			uint32_t y = (j << 1) | ((c >> 1) & 1);
+			uint32_t z = (k << 1) | (c & 1);
+			
+			occupied = voxels[(x * size + y) * size + z] != 0;
+		}
+		
+		set_bit(1, i, j, k, occupied);
+	}
+	
+	for(uint8_t l = 2; l <= factor; l++)
+	{
+		side = 1 << (factor - l);
+		
+		for(uint16_t i = 0; i < side; i++)
+		for(uint16_t j = 0; j < side; j++)
+		for(uint16_t k = 0; k < side; k++)
+			set_bit(l, i, j, k, is_child_occupied(l, i, j, k));
+	}
+}
+
+uint32_t occupancy_pyramid::get_cell_index(uint8_t level, uint16_t x, uint16_t y, uint16_t z) const
+{
+	uint8_t side_factor = factor - level;
+	return (((uint32_t) x << (side_factor << 1)) | ((uint32_t) y << side_factor) | z);
+}
+
+uint8_t occupancy_pyramid::get_empty_level(uint16_t x, uint16_t y, uint16_t z) const
+{
+	for(uint8_t l = factor; l >= 1; l--)
+		if(!is_occupied(l, x >> l, y >> l, z >> l)) return l;
+	
+	return 0;
+}
+
+uint8_t occupancy_pyramid::get_levels() const
+{
+	return factor;
+}
+
+bool occupancy_pyramid::is_box_occupied(const uint16_t min[3], const uint16_t max[3], const std::function<bool(uint16_t, uint16_t, uint16_t)>& is_solid) const
+{
+	struct cell
+	{
+		uint8_t level;
+		uint16_t x, y, z;
+	};
+	
+	std::vector<cell> stack;
+	stack.push_back({factor, 0, 0, 0});
+	
+	while(!stack.empty())
+	{
+		cell c = stack.back();
+		stack.pop_back();
+		
+		uint16_t pos[3] = {c.x, c.y, c.z};
+		bool inside = true;
+		bool outside = false;
+		
+		for(uint8_t a = 0; a < 3; a++)
+		{
+			uint32_t start = (uint32_t) pos[a] << c.level;
+			uint32_t end = start + (1 << c.level) - 1;
+			
+			outside |= end < min[a] || start > max[a];
+			inside &= start >= min[a] && end <= max[a];
+		}
+		
+		if(outside) continue;
+		
+		if(c.level == 0)
+		{
+			if(is_solid(c.x, c.y, c.z)) return true;
+			continue;
+		}
+		
+		if(!is_occupied(c.level, c.x, c.y, c.z)) continue;
+		
+		//Something in here is non-zero, and all of it is in the box.
+		if(inside) return true;
+		
+		for(uint32_t child = 0; child < 8; child++)
+			stack.push_back({(uint8_t) (c.level - 1), (uint16_t) ((c.x << 1) | (child >> 2)), (uint16_t) ((c.y << 1) | ((child >> 1) & 1)), (uint16_t) ((c.z << 1) | (child & 1))});
+	}
+	
+	return false;
+}
+
+bool occupancy_pyramid::is_child_occupied(uint8_t level, uint16_t x, uint16_t y, uint16_t z) const
+{
+	for(uint32_t c = 0; c < 8; c++)
+		if(is_occupied(level - 1, (x << 1) | (c >> 2), (y << 1) | ((c >> 1) & 1), (z << 1) | (c & 1))) return true;
+	
+	return false;
+}
+
+bool occupancy_pyramid::is_occupied(uint8_t level, uint16_t x, uint16_t y, uint16_t z) const
+{
+	uint32_t index = get_cell_index(level, x, y, z);
+	return (levels[level - 1][index >> 6] >> (index & 63)) & 1;
+}
+
+bool occupancy_pyramid::raycast(const float origin[3], const float direction[3], float max_distance, const std::function<bool(uint16_t, uint16_t, uint16_t)>& is_solid, uint16_t hit[3], float* distance) const
+{
+	float size = (float) (1 << factor);
+	
+	//Clip the ray to the volume first.
+	float t_min = 0;
+	float t_max = max_distance;
+	
+	for(uint8_t a = 0; a < 3; a++)
+	{
+		if(direction[a] == 0)
+		{
+			if(origin[a] < 0 || origin[a] >= size) return false;
+			continue;
+		}
+		
+		float t0 = (0 - origin[a]) / direction[a];
+		float t1 = (size - origin[a]) / direction[a];
+		if(t0 > t1) std::swap(t0, t1);
+		
+		t_min = std::max(t_min, t0);
+		t_max = std::min(t_max, t1);
+	}
+	
+	bool inside = origin[0] >= 0 && origin[1] >= 0 && origin[2] >= 0 && origin[0] < size && origin[1] < size && origin[2] < size;
+	
+	//Only touching the outside of the volume doesn't count, but a ray starting inside always looks at the voxel it starts in.
+	if(t_min > t_max || (t_min == t_max && !inside)) return false;
+	
+	float t = t_min;
+	do
+	{
+		uint16_t voxel[3];
+		for(uint8_t a = 0; a < 3; a++)
+		{
+			float p = std::floor(origin[a] + direction[a] * t);
+			voxel[a] = (uint16_t) std::min(std::max(p, 0.0f), size - 1);
+		}
+		
+		uint8_t level = get_empty_level(voxel[0], voxel[1], voxel[2]);
+		
+		if(level == 0 && is_solid(voxel[0], voxel[1], voxel[2]))
+		{
+			hit[0] = voxel[0];
+			hit[1] = voxel[1];
+			hit[2] = voxel[2];
+			*distance = t;
+			return true;
+		}
+		
+		//Jump to where the ray leaves the empty cell (or the voxel, if nothing around it is empty).
+		float t_exit = t_max;
+		for(uint8_t a = 0; a < 3; a++)
+		{
+			if(direction[a] == 0) continue;
+			
+			float cell_start = (float) ((voxel[a] >> level) << level);
+			float boundary = direction[a] > 0 ? cell_start + (1 << level) : cell_start;
+			
+			t_exit = std::min(t_exit, (boundary - origin[a]) / direction[a]);
+		}
+		
+		t = std::max(t_exit, t) + OCCUPANCY_RAY_EPSILON;
+	}
+	while(t < t_max);
+	
+	return false;
+}
+
+void occupancy_pyramid::set_bit(uint8_t level, uint16_t x, uint16_t y, uint16_t z, bool occupied)
+{
+	uint32_t index = get_cell_index(level, x, y, z);
+	uint64_t bit = (uint64_t) 1 << (index & 63);
+	
+	if(occupied) levels[level - 1][index >> 6] |= bit;
+	else levels[level - 1][index >> 6] &= ~bit;
+}
+
+void occupancy_pyramid::set_cell(uint16_t x, uint16_t y, uint16_t z, bool occupied)
+{
+	set_bit(1, x >> 1, y >> 1, z >> 1, occupied);
+	
+	for(uint8_t l = 2; l <= factor; l++)
+	{
+		//An occupied cell makes all of its parents occupied, an empty one only empties them if its siblings are empty too.
+		bool parent = occupied || is_child_occupied(l, x >> l, y >> l, z >> l);
+		if(parent == is_occupied(l, x >> l, y >> l, z >> l)) break;
+		
+		set_bit(l, x >> l, y >> l, z >> l, parent);
+	}
+}
@@ -0,0 +1,49 @@
+#ifndef _OCCUPANCY_H_
+#define _OCCUPANCY_H_
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+//Level 0 are the voxels themselves, which aren't stored here. Every level above halves the side, up to a single cell for the whole volume.
+//A cell is occupied if any voxel inside it is non-zero, so finding an empty cell rules out that whole part of the volume at once.
+class occupancy_pyramid
+{
+	public:
+		//Covers a (1 << factor)^3 volume.
+		occupancy_pyramid(uint8_t factor);
+		
+		//voxels are [x][y][z], same as voxel codes.
+		void build(const uint32_t* voxels);
+		
+		//Highest level whose cell around voxel (x, y, z) is empty, or 0 if even the level 1 cell is occupied.
+		uint8_t get_empty_level(uint16_t x, uint16_t y, uint16_t z) const;
+		
+		uint8_t get_levels() const;
+		
+		//Whether any voxel in the box (bounds inclusive) is non-zero. is_solid is only asked about voxels in occupied level 1 cells on the edges of the box.
+		bool is_box_occupied(const uint16_t min[3], const uint16_t max[3], const std::function<bool(uint16_t, uint16_t, uint16_t)>& is_solid) const;
+		
+		//x, y and z are cell coordinates at that level, level 1 and up.
+		bool is_occupied(uint8_t level, uint16_t x, uint16_t y, uint16_t z) const;
+		
+		//Casts a ray through the volume, in voxel units, where voxel (x, y, z) spans [x, x + 1). direction doesn't need to be normalized, distances are in multiples of it.
+		//Empty cells are skipped as a whole, is_solid is only asked about voxels in occupied level 1 cells along the way.
+		bool raycast(const float origin[3], const float direction[3], float max_distance, const std::function<bool(uint16_t, uint16_t, uint16_t)>& is_solid, uint16_t hit[3], float* distance) const;
+		
+		//Updates the level 1 cell holding voxel (x, y, z), and the levels above it.
+		void set_cell(uint16_t x, uint16_t y, uint16_t z, bool occupied);
+	private:
+		uint8_t factor;
+		
+		//levels[l - 1] is level l, one bit per cell, [x][y][z].
+		std::vector<std::vector<uint64_t> > levels;
+		
+		uint32_t get_cell_index(uint8_t level, uint16_t x, uint16_t y, uint16_t z) const;
+		
+		bool is_child_occupied(uint8_t level, uint16_t x, uint16_t y, uint16_t z) const;
+		
+		void set_bit(uint8_t level, uint16_t x, uint16_t y, uint16_t z, bool occupied);
+};
+
+#endif
@@ -0,0 +1,279 @@
+#include "octree.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "../utils/hash.h"
+
+//Nudges a ray past the boundary of the cube it just left, so it lands in the next one.
+#define OCTREE_RAY_EPSILON 1e-4f
+
+static uint8_t count_bits(uint8_t value)
+{
+	uint8_t count = 0;
+	for(; value != 0; value &= value - 1)
+		count++;
+	
+	return count;
+}
+
+static uint32_t get_leaf_bit(uint16_t x, uint16_t y, uint16_t z)
+{
+	uint16_t bound = OCTREE_LEAF_SIZE - 1;
+	return (((x & bound) << (OCTREE_LEAF_FACTOR << 1)) | ((y & bound) << OCTREE_LEAF_FACTOR) | (z & bound));
+}
+
+sparse_octree::sparse_octree()
+{
+	factor = 0;
+	root_state = OCTREE_EMPTY;
+	root = {0, 0, 0};
+}
+
+void sparse_octree::build(uint8_t factor, const std::function<uint8_t(uint16_t, uint16_t, uint16_t, uint16_t)>& classify, const std::function<bool(uint16_t, uint16_t, uint16_t)>& is_solid)
+{
+	this->factor = factor;
+	
+	nodes.clear();
+	leaf_refs.clear();
+	leaves.clear();
+	
+	//Keyed by content hash, like the brick registry. Only lives for the build.
+	std::unordered_map<uint64_t, std::vector<uint32_t> > leaf_lookup;
+	
+	uint32_t root_leaf;
+	root_state = build_cube(0, 0, 0, factor, classify, is_solid, leaf_lookup, &root, &root_leaf);
+	
+	//A volume no bigger than a leaf has no nodes at all, it's stored as a root above a single leaf.
+	if(root_state == OCTREE_MIXED && factor <= OCTREE_LEAF_FACTOR)
+	{
+		root = {(uint32_t) leaf_refs.size(), 0, 0};
+		leaf_refs.push_back(root_leaf);
+	}
+	
+	nodes.shrink_to_fit();
+	leaf_refs.shrink_to_fit();
+	leaves.shrink_to_fit();
+}
+
+uint8_t sparse_octree::build_cube(uint16_t x, uint16_t y, uint16_t z, uint8_t size_factor, const std::function<uint8_t(uint16_t, uint16_t, uint16_t, uint16_t)>& classify, const std::function<bool(uint16_t, uint16_t, uint16_t)>& is_solid, std::unordered_map<uint64_t, std::vector<uint32_t> >& leaf_lookup, octree_node* node, uint32_t* leaf)
+{
+	uint16_t size = 1 << size_factor;
+	
+	uint8_t state = classify(x, y, z, size);
+	if(state != OCTREE_MIXED) return state;
+	
+	if(size_factor <= OCTREE_LEAF_FACTOR)
+	{
+		octree_leaf l;
+		std::memset(&l, 0, sizeof(l));
+		
+		uint32_t solid = 0;
+		for(uint16_t i = x; i < x + size; i++)
+		for(uint16_t j = y; j < y + size; j++)
+		for(uint16_t k = z; k < z + size; k++)
+		{
+			if(!is_solid(i, j, k)) continue;
+			
+			uint32_t bit = get_leaf_bit(i, j, k);
+			l.bits[bit >> 6] |= (uint64_t) 1 << (bit & 63);
+			solid++;
+		}
+		
+		if(solid == 0) return OCTREE_EMPTY;
+		if(solid == (uint32_t) size * size * size) return OCTREE_FULL;
+		
+		uint64_t hash = hash::hash64(&l, sizeof(l));
+		
+		std::vector<uint32_t>& candidates = leaf_lookup[hash];
+		for(size_t i = 0; i < candidates.size(); i++)
+		{
+			if(std::memcmp(&leaves[candidates[i]], &l, sizeof(l)) == 0)
+			{
+				*leaf = candidates[i];
+				return OCTREE_MIXED;
+			}
+		}
+		
+		*leaf = leaves.size();
+		candidates.push_back(*leaf);
+		leaves.push_back(l);
+		
+		return OCTREE_MIXED;
+	}
+	
+	uint8_t child_factor = size_factor - 1;
+	uint16_t child_size = 1 << child_factor;
+	
+	octree_node children[8];
+	uint32_t child_leaves[8];
+	
+	node->child_mask = 0;
+	node->full_mask = 0;
+	
+	for(uint8_t c = 0; c < 8; c++)
+	{
+		uint16_t child_x = x + ((c >> 2) & 1) * child_size;
+		uint16_t child_y = y + ((c >> 1) & 1) * child_size;
+		uint16_t child_z = z + (c & 1) * child_size;
+		
+		uint8_t child_state = build_cube(child_x, child_y, child_z, child_factor, classify, is_solid, leaf_lookup, &children[c], &child_leaves[c]);
+		
+		if(child_state != OCTREE_EMPTY) node->child_mask |= 1 << c;
+		if(child_state == OCTREE_FULL) node->full_mask |= 1 << c;
+	}
+	
+	if(node->child_mask == 0) return OCTREE_EMPTY;
+	if(node->full_mask == 0xFF) return OCTREE_FULL;
+	
+	//Every child's own children are already stored by now, so a node's children always end up next to each other.
+	uint8_t stored = node->child_mask & ~node->full_mask;
+	
+	if(child_factor <= OCTREE_LEAF_FACTOR)
+	{
+		node->first_child = leaf_refs.size();
+		for(uint8_t c = 0; c < 8; c++)
+			if(stored & (1 << c)) leaf_refs.push_back(child_leaves[c]);
+	}
+	else
+	{
+		node->first_child = nodes.size();
+		for(uint8_t c = 0; c < 8; c++)
+			if(stored & (1 << c)) nodes.push_back(children[c]);
+	}
+	
+	return OCTREE_MIXED;
+}
+
+size_t sparse_octree::get_leaf_count() const
+{
+	return leaves.size();
+}
+
+size_t sparse_octree::get_memory() const
+{
+	return sizeof(*this) + nodes.capacity() * sizeof(octree_node) + leaf_refs.capacity() * sizeof(uint32_t) + leaves.capacity() * sizeof(octree_leaf);
+}
+
+size_t sparse_octree::get_node_count() const
+{
+	return nodes.size() + (root_state == OCTREE_MIXED ? 1 : 0);
+}
+
+uint8_t sparse_octree::lookup(uint16_t x, uint16_t y, uint16_t z, uint8_t max_depth, uint8_t* size_factor) const
+{
+	*size_factor = factor;
+	if(root_state != OCTREE_MIXED) return root_state;
+	
+	const octree_node* node = &root;
+	
+	for(uint8_t depth = 0; ; depth++)
+	{
+		if(depth >= max_depth) return OCTREE_MIXED;
+		
+		//Volumes no bigger than a leaf go straight to it.
+		if(*size_factor <= OCTREE_LEAF_FACTOR)
+		{
+			const octree_leaf& l = leaves[leaf_refs[node->first_child]];
+			uint32_t bit = get_leaf_bit(x, y, z);
+			
+			*size_factor = 0;
+			return (l.bits[bit >> 6] >> (bit & 63)) & 1 ? OCTREE_FULL : OCTREE_EMPTY;
+		}
+		
+		(*size_factor)--;
+		
+		uint8_t octant = (((x >> *size_factor) & 1) << 2) | (((y >> *size_factor) & 1) << 1) | ((z >> *size_factor) & 1);
+		uint8_t bit = 1 << octant;
+		
+		if((node->child_mask & bit) == 0) return OCTREE_EMPTY;
+		if((node->full_mask & bit) != 0) return OCTREE_FULL;
+		
+		uint8_t stored = node->child_mask & ~node->full_mask;
+		uint32_t index = node->first_child + count_bits(stored & (bit - 1));
+		
+		if(*size_factor > OCTREE_LEAF_FACTOR)
+		{
+			node = &nodes[index];
+			continue;
+		}
+		
+		if(depth + 1 >= max_depth) return OCTREE_MIXED;
+		
+		const octree_leaf& l = leaves[leaf_refs[index]];
+		uint32_t leaf_bit = get_leaf_bit(x, y, z);
+		
+		*size_factor = 0;
+		return (l.bits[leaf_bit >> 6] >> (leaf_bit & 63)) & 1 ? OCTREE_FULL : OCTREE_EMPTY;
+	}
+}
+
+bool sparse_octree::raycast(const float origin[3], const float direction[3], float max_distance, uint8_t max_depth, uint16_t hit[3], uint8_t* hit_size_factor, float* distance) const
+{
+	float size = (float) (1 << factor);
+	
+	//Clip the ray to the volume first.
+	float t_min = 0;
+	float t_max = max_distance;
+	
+	for(uint8_t a = 0; a < 3; a++)
+	{
+		if(direction[a] == 0)
+		{
+			if(origin[a] < 0 || origin[a] >= size) return false;
+			continue;
+		}
+		
+		float t0 = (0 - origin[a]) / direction[a];
+		float t1 = (size - origin[a]) / direction[a];
+		if(t0 > t1) std::swap(t0, t1);
+		
+		t_min = std::max(t_min, t0);
+		t_max = std::min(t_max, t1);
+	}
+	
+	bool inside = origin[0] >= 0 && origin[1] >= 0 && origin[2] >= 0 && origin[0] < size && origin[1] < size && origin[2] < size;
+	
+	//Only touching the outside of the volume doesn't count, but a ray starting inside always looks at the voxel it starts in.
+	if(t_min > t_max || (t_min == t_max && !inside)) return false;
+	
+	float t = t_min;
+	do
+	{
+		uint16_t voxel[3];
+		for(uint8_t a = 0; a < 3; a++)
+		{
+			float p = std::floor(origin[a] + direction[a] * t);
+			voxel[a] = (uint16_t) std::min(std::max(p, 0.0f), size - 1);
+		}
+		
+		uint8_t size_factor;
+		if(lookup(voxel[0], voxel[1], voxel[2], max_depth, &size_factor) != OCTREE_EMPTY)
+		{
+			for(uint8_t a = 0; a < 3; a++)
+				hit[a] = (voxel[a] >> size_factor) << size_factor;
+			
+			*hit_size_factor = size_factor;
+			*distance = t;
+			return true;
+		}
+		
+		//Jump to where the ray leaves the empty cube.
+		float t_exit = t_max;
+		for(uint8_t a = 0; a < 3; a++)
+		{
+			if(direction[a] == 0) continue;
+			
+			float cube_start = (float) ((voxel[a] >> size_factor) << size_factor);
+			float boundary = direction[a] > 0 ? cube_start + (1 << size_factor) : cube_start;
+			
+			t_exit = std::min(t_exit, (boundary - origin[a]) / direction[a]);
+		}
+		
+		t = std::max(t_exit, t) + OCTREE_RAY_EPSILON;
+	}
+	while(t < t_max);
+	
+	return false;
+}
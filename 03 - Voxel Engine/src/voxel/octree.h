@@ -0,0 +1,69 @@
+#ifndef _OCTREE_H_
+#define _OCTREE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+//Leaves are 8^3 voxels, one bit each, the same size as a brick.
+#define OCTREE_LEAF_FACTOR 3
+#define OCTREE_LEAF_SIZE (1<<OCTREE_LEAF_FACTOR)
+
+#define OCTREE_EMPTY 0
+#define OCTREE_FULL 1
+#define OCTREE_MIXED 2
+
+struct octree_node
+{
+	//Index of the first stored child, in nodes, or in leaf_refs for nodes right above the leaves.
+	//Only mixed children are stored, in octant order. Empty and full ones are told apart by the masks alone.
+	uint32_t first_child;
+	
+	//Octant bits are (x << 2) | (y << 1) | z. child_mask has a bit for every non-empty child, full_mask for every completely solid one.
+	uint8_t child_mask;
+	uint8_t full_mask;
+};
+
+struct octree_leaf
+{
+	//[x][y][z], one bit per voxel.
+	uint64_t bits[OCTREE_LEAF_SIZE * OCTREE_LEAF_SIZE * OCTREE_LEAF_SIZE / 64];
+};
+
+//Only stores solidity, for things only seen from far away. Identical leaves are stored once.
+class sparse_octree
+{
+	public:
+		sparse_octree();
+		
+		//classify tells whether the cube at (x, y, z) of side size is OCTREE_EMPTY, OCTREE_FULL, or OCTREE_MIXED if it isn't known.
+		//Only the voxels of leaves that couldn't be classified are asked for through is_solid.
+		void build(uint8_t factor, const std::function<uint8_t(uint16_t, uint16_t, uint16_t, uint16_t)>& classify, const std::function<bool(uint16_t, uint16_t, uint16_t)>& is_solid);
+		
+		size_t get_leaf_count() const;
+		size_t get_memory() const;
+		size_t get_node_count() const;
+		
+		//Returns the state of the cube holding voxel (x, y, z), and its size as a power of two. Descends at most max_depth levels below the root, a cube still mixed there is returned as OCTREE_MIXED.
+		//Leaves are either returned whole, or looked into right down to the voxel.
+		uint8_t lookup(uint16_t x, uint16_t y, uint16_t z, uint8_t max_depth, uint8_t* size_factor) const;
+		
+		//Same conventions as occupancy_pyramid::raycast(). Cubes still mixed at max_depth count as solid, hit and hit_size_factor give the cube that was hit.
+		bool raycast(const float origin[3], const float direction[3], float max_distance, uint8_t max_depth, uint16_t hit[3], uint8_t* hit_size_factor, float* distance) const;
+	private:
+		uint8_t factor;
+		
+		uint8_t root_state;
+		octree_node root;
+		
+		std::vector<octree_node> nodes;
+		std::vector<uint32_t> leaf_refs;
+		std::vector<octree_leaf> leaves;
+		
+		//Returns the state of the cube. Mixed cubes fill in node, or leaf with the index of their (shared) leaf.
+		uint8_t build_cube(uint16_t x, uint16_t y, uint16_t z, uint8_t size_factor, const std::function<uint8_t(uint16_t, uint16_t, uint16_t, uint16_t)>& classify, const std::function<bool(uint16_t, uint16_t, uint16_t)>& is_solid, std::unordered_map<uint64_t, std::vector<uint32_t> >& leaf_lookup, octree_node* node, uint32_t* leaf);
+};
+
+#endif
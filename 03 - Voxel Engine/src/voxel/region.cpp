@@ -0,0 +1,575 @@
+#include "region.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "../utils/compress.h"
+#include "../utils/durable_file.h"
+#include "../utils/hash.h"
+#include "../utils/mapped_file.h"
+
+//Uncomment to print the size of every sector payload written.
+//#define DEBUG_REGION_PRINT
+
+#define REGION_MAGIC 0x47525856
+#define REGION_VERSION 1
+
+#define REGION_PAYLOAD_RAW 0
+#define REGION_PAYLOAD_RLE 1
+#define REGION_PAYLOAD_EDITS 2
+
+//Once this many bytes of replaced payloads are waiting for region::sync(), the writer syncs the region file itself so they can be reused.
+#define REGION_REPLACED_SYNC_SIZE (1 << 20)
+
+//Uncomment to evict region files from the page cache before mapping them, so DEBUG_WORLD_TIMING measures cold loads.
+//#define DEBUG_REGION_COLD_CACHE
+
+struct region_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t region_size;
+	uint32_t reserved;
+};
+
+struct region_entry
+{
+	uint64_t offset;
+	uint32_t size;
+	uint32_t raw_size;
+	uint32_t checksum;
+	uint32_t payload_type;
+};
+
+#define REGION_TABLE_OFFSET sizeof(region_header)
+#define REGION_DATA_OFFSET (REGION_TABLE_OFFSET + REGION_SECTOR_COUNT * sizeof(region_entry))
+
+struct region_file
+{
+	std::string path;
+	
+	//Writes go through the stream, reads come straight out of the mapping.
+	std::fstream file;
+	mapped_file map;
+	
+	region_entry table[REGION_SECTOR_COUNT];
+	uint64_t end;
+	
+	//Space between payloads that no table entry points at, as offset -> size. New payloads go in the first gap they fit in.
+	std::map<uint64_t, uint64_t> free_space;
+	
+	//Payloads replaced since the last region::sync(). The table on disk may still point at them, so they're only reused once it's synced.
+	std::vector<std::pair<uint64_t, uint64_t> > replaced;
+	uint64_t replaced_size;
+	
+	//Set when something was written since the last region::sync().
+	bool dirty;
+
+	std::mutex lock;
+};
+
+struct save_job
+{
+	int64_t x, y, z;
+	
+	//Either the full voxel array, or sorted (voxel code, value) pairs when edits_only is set.
+	std::vector<uint32_t> data;
+	bool edits_only;
+};
+
+typedef std::tuple<int64_t, int64_t, int64_t> region_key;
+
+static std::string save_directory;
+
+static std::map<region_key, std::unique_ptr<region_file> > region_files;
+static std::mutex region_files_lock;
+
+static std::deque<std::shared_ptr<save_job> > save_queue;
+static std::shared_ptr<save_job> save_in_flight;
+static std::mutex save_queue_lock;
+static std::condition_variable save_queue_cv;
+static std::condition_variable save_done_cv;
+
+static std::thread writer_thread;
+static bool writer_running = false;
+
+static int64_t floor_div_region(int64_t a)
+{
+	return a >= 0 ? a / REGION_SIZE : (a - REGION_SIZE + 1) / REGION_SIZE;
+}
+
+static uint32_t get_region_local_index(int64_t x, int64_t y, int64_t z)
+{
+	uint32_t lx = (uint32_t) (x - floor_div_region(x) * REGION_SIZE);
+	uint32_t ly = (uint32_t) (y - floor_div_region(y) * REGION_SIZE);
+	uint32_t lz = (uint32_t) (z - floor_div_region(z) * REGION_SIZE);
+
+	return (lx << (REGION_FACTOR << 1)) | (ly << REGION_FACTOR) | lz;
+}
+
+static std::string get_region_path(int64_t rx, int64_t ry, int64_t rz)
+{
+	return save_directory + "r." + std::to_string(rx) + "." + std::to_string(ry) + "." + std::to_string(rz) + ".vxr";
+}
+
+//Must be called with the region lock held. Merges the range with the free space around it.
+static void add_free_space(region_file* rf, uint64_t offset, uint64_t size)
+{
+	auto next = rf->free_space.lower_bound(offset);
+
+	if(next != rf->free_space.begin())
+	{
+		auto prev = std::prev(next);
+		if(prev->first + prev->second == offset)
+		{
+			offset = prev->first;
+			size += prev->second;
+			rf->free_space.erase(prev);
+		}
+	}
+
+	if(next != rf->free_space.end() && offset + size == next->first)
+	{
+		size += next->second;
+		rf->free_space.erase(next);
+	}
+
+	rf->free_space[offset] = size;
+}
+
+//Must be called with the region lock held. First fit, so payloads are packed towards the start of the file.
+static bool take_free_space(region_file* rf, uint64_t size, uint64_t* offset)
+{
+	for(auto it = rf->free_space.begin(); it != rf->free_space.end(); it++)
+	{
+		if(it->second < size) continue;
+
+		*offset = it->first;
+
+		uint64_t rest = it->second - size;
+		rf->free_space.erase(it);
+		if(rest > 0) rf->free_space[*offset + size] = rest;
+
+		return true;
+	}
+
+	return false;
+}
+
+//Payloads of sectors that were saved again leave gaps behind, they're found by sorting the table.
+static void find_free_space(region_file* rf)
+{
+	std::vector<std::pair<uint64_t, uint64_t> > payloads;
+	for(uint32_t i = 0; i < REGION_SECTOR_COUNT; i++)
+		if(rf->table[i].size > 0) payloads.push_back(std::make_pair(rf->table[i].offset, (uint64_t) rf->table[i].size));
+
+	std::sort(payloads.begin(), payloads.end());
+
+	uint64_t offset = REGION_DATA_OFFSET;
+	for(size_t i = 0; i < payloads.size(); i++)
+	{
+		if(payloads[i].first > offset) add_free_space(rf, offset, payloads[i].first - offset);
+		offset = std::max(offset, payloads[i].first + payloads[i].second);
+	}
+
+	if(rf->end > offset) add_free_space(rf, offset, rf->end - offset);
+}
+
+static region_file* open_region(int64_t x, int64_t y, int64_t z, bool create)
+{
+	int64_t rx = floor_div_region(x);
+	int64_t ry = floor_div_region(y);
+	int64_t rz = floor_div_region(z);
+
+	std::lock_guard<std::mutex> guard(region_files_lock);
+
+	region_key key = std::make_tuple(rx, ry, rz);
+	auto it = region_files.find(key);
+	if(it != region_files.end()) return it->second.get();
+
+	std::string path = get_region_path(rx, ry, rz);
+	bool exists = std::filesystem::exists(path);
+	if(!exists && !create) return nullptr;
+
+	std::unique_ptr<region_file> rf = std::make_unique<region_file>();
+	rf->path = path;
+	rf->dirty = false;
+	rf->replaced_size = 0;
+
+	if(!exists)
+	{
+		region_header header{};
+		header.magic = REGION_MAGIC;
+		header.version = REGION_VERSION;
+		header.region_size = REGION_SIZE;
+
+		std::memset(rf->table, 0, sizeof(rf->table));
+
+		std::ofstream out(path, std::ios::binary);
+		out.write((const char*) &header, sizeof(header));
+		out.write((const char*) rf->table, sizeof(rf->table));
+		out.close();
+
+		if(!out.good())
+		{
+			std::cerr << "[VOX|ERR] Failed to create region file: " << path << std::endl;
+			return nullptr;
+		}
+	}
+
+	rf->file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+	if(!rf->file.is_open())
+	{
+		std::cerr << "[VOX|ERR] Failed to open region file: " << path << std::endl;
+		return nullptr;
+	}
+
+	region_header header;
+	rf->file.read((char*) &header, sizeof(header));
+	rf->file.read((char*) rf->table, sizeof(rf->table));
+
+	if(!rf->file.good() || header.magic != REGION_MAGIC || header.version != REGION_VERSION || header.region_size != REGION_SIZE)
+	{
+		std::cerr << "[VOX|ERR] Region file is corrupt or from an incompatible version: " << path << std::endl;
+		return nullptr;
+	}
+
+	rf->file.seekg(0, std::ios::end);
+	rf->end = (uint64_t) rf->file.tellg();
+	if(rf->end < REGION_DATA_OFFSET) rf->end = REGION_DATA_OFFSET;
+
+	find_free_space(rf.get());
+
+#ifdef DEBUG_REGION_COLD_CACHE
+	if(rf->map.open(path))
+	{
+		rf->map.drop_page_cache();
+		rf->map.close();
+	}
+#endif
+
+	region_file* ptr = rf.get();
+	region_files[key] = std::move(rf);
+	return ptr;
+}
+
+//Must be called with the region lock held. Once the table on disk is up to date, replaced payloads can be written over.
+static bool sync_region(region_file* rf)
+{
+	if(!durable_file::sync_path(rf->path))
+	{
+		std::cerr << "[VOX|ERR] Failed to sync region file: " << rf->path << std::endl;
+		return false;
+	}
+
+	rf->dirty = false;
+
+	for(size_t i = 0; i < rf->replaced.size(); i++)
+		add_free_space(rf, rf->replaced[i].first, rf->replaced[i].second);
+
+	rf->replaced.clear();
+	rf->replaced_size = 0;
+	return true;
+}
+
+//Must be called with the region lock held. The file only ever grows, so the mapping is only redone when it doesn't cover the requested range.
+static bool map_region(region_file* rf, uint64_t required_size)
+{
+	if(rf->map.is_open() && rf->map.get_size() >= required_size) return true;
+
+	rf->file.flush();
+	return rf->map.open(rf->path) && rf->map.get_size() >= required_size;
+}
+
+static bool write_sector(const save_job& job)
+{
+	region_file* rf = open_region(job.x, job.y, job.z, true);
+	if(rf == nullptr) return false;
+
+	size_t raw_size = job.data.size() * sizeof(uint32_t);
+
+	std::vector<uint8_t> payload;
+	uint32_t payload_type;
+
+	if(job.edits_only)
+	{
+		payload_type = REGION_PAYLOAD_EDITS;
+		compress::sparse_encode(job.data.data(), job.data.size() / 2, payload);
+	}
+	else
+	{
+		payload_type = REGION_PAYLOAD_RLE;
+		compress::rle_encode(job.data.data(), job.data.size(), payload);
+
+		//Noisy sectors can end up larger after RLE. In that case, store them raw.
+		if(payload.size() >= raw_size)
+		{
+			payload.resize(raw_size);
+			std::memcpy(payload.data(), job.data.data(), raw_size);
+			payload_type = REGION_PAYLOAD_RAW;
+		}
+	}
+
+	uint32_t index = get_region_local_index(job.x, job.y, job.z);
+
+	std::lock_guard<std::mutex> guard(rf->lock);
+
+	region_entry entry;
+	entry.size = (uint32_t) payload.size();
+	entry.raw_size = (uint32_t) raw_size;
+	entry.checksum = hash::crc32(payload.data(), payload.size());
+	entry.payload_type = payload_type;
+
+	bool appended = !take_free_space(rf, entry.size, &entry.offset);
+	if(appended) entry.offset = rf->end;
+
+	//The payload never overwrites one the table points at, and the table entry is only updated afterwards.
+	//If we die in between, the table still points at the previous (intact) payload.
+	rf->file.seekp(entry.offset);
+	rf->file.write((const char*) payload.data(), payload.size());
+	rf->file.flush();
+
+	rf->file.seekp(REGION_TABLE_OFFSET + index * sizeof(region_entry));
+	rf->file.write((const char*) &entry, sizeof(entry));
+	rf->file.flush();
+
+	if(!rf->file.good())
+	{
+		std::cerr << "[VOX|ERR] Failed to write sector (" << job.x << ", " << job.y << ", " << job.z << ") to region file." << std::endl;
+		rf->file.clear();
+		if(!appended) add_free_space(rf, entry.offset, entry.size);
+		return false;
+	}
+
+	if(rf->table[index].size > 0)
+	{
+		rf->replaced.push_back(std::make_pair(rf->table[index].offset, (uint64_t) rf->table[index].size));
+		rf->replaced_size += rf->table[index].size;
+	}
+
+	rf->table[index] = entry;
+	if(appended) rf->end += entry.size;
+	rf->dirty = true;
+
+	if(rf->replaced_size >= REGION_REPLACED_SYNC_SIZE) sync_region(rf);
+
+#ifdef DEBUG_REGION_PRINT
+	std::cout << "[VOX|INF] Saved sector (" << job.x << ", " << job.y << ", " << job.z << "): " << entry.size << " bytes" << (job.edits_only ? " (edits only)." : ".") << std::endl;
+#endif
+
+	return true;
+}
+
+static void writer_thread_loop()
+{
+	std::unique_lock<std::mutex> lock(save_queue_lock);
+
+	while(true)
+	{
+		save_queue_cv.wait(lock, []{ return !save_queue.empty() || !writer_running; });
+
+		if(save_queue.empty())
+		{
+			if(!writer_running) break;
+			continue;
+		}
+
+		save_in_flight = save_queue.front();
+		save_queue.pop_front();
+
+		lock.unlock();
+		write_sector(*save_in_flight);
+		lock.lock();
+
+		save_in_flight = nullptr;
+		save_done_cv.notify_all();
+	}
+}
+
+static uint8_t load_pending_job(const save_job& job, uint32_t* voxels, size_t count, std::vector<uint32_t>* edits)
+{
+	if(job.edits_only)
+	{
+		*edits = job.data;
+		return REGION_LOAD_EDITS;
+	}
+
+	if(job.data.size() != count) return REGION_LOAD_FAILED;
+
+	std::memcpy(voxels, job.data.data(), count * sizeof(uint32_t));
+	return REGION_LOAD_VOXELS;
+}
+
+static void queue_save_job(int64_t x, int64_t y, int64_t z, std::vector<uint32_t> data, bool edits_only)
+{
+	std::shared_ptr<save_job> job = std::make_shared<save_job>();
+	job->x = x;
+	job->y = y;
+	job->z = z;
+	job->data = std::move(data);
+	job->edits_only = edits_only;
+
+	{
+		std::lock_guard<std::mutex> guard(save_queue_lock);
+		save_queue.push_back(job);
+	}
+	save_queue_cv.notify_one();
+}
+
+void region::deinit()
+{
+	{
+		std::lock_guard<std::mutex> guard(save_queue_lock);
+		writer_running = false;
+	}
+	save_queue_cv.notify_all();
+
+	if(writer_thread.joinable()) writer_thread.join();
+
+	std::lock_guard<std::mutex> guard(region_files_lock);
+	region_files.clear();
+
+#ifdef DEBUG_PRINT_SUCCESS
+	std::cout << "[VOX|INF] Closed all region files." << std::endl;
+#endif
+}
+
+void region::flush()
+{
+	std::unique_lock<std::mutex> lock(save_queue_lock);
+	save_done_cv.wait(lock, []{ return save_queue.empty() && save_in_flight == nullptr; });
+}
+
+bool region::init(const std::string& directory)
+{
+	save_directory = directory;
+
+	std::error_code ec;
+	std::filesystem::create_directories(save_directory, ec);
+	if(ec)
+	{
+		std::cerr << "[VOX|ERR] Failed to create save directory: " << save_directory << " (" << ec.message() << ")" << std::endl;
+		return false;
+	}
+
+	writer_running = true;
+	writer_thread = std::thread(writer_thread_loop);
+
+	return true;
+}
+
+uint8_t region::load_sector(int64_t x, int64_t y, int64_t z, uint32_t* voxels, size_t count, std::vector<uint32_t>* edits)
+{
+	//A sector that was unloaded and is coming back before the writer got to it is served straight from the queue.
+	{
+		std::lock_guard<std::mutex> guard(save_queue_lock);
+
+		for(auto it = save_queue.rbegin(); it != save_queue.rend(); it++)
+		{
+			const save_job& job = **it;
+			if(job.x == x && job.y == y && job.z == z) return load_pending_job(job, voxels, count, edits);
+		}
+
+		if(save_in_flight != nullptr && save_in_flight->x == x && save_in_flight->y == y && save_in_flight->z == z)
+			return load_pending_job(*save_in_flight, voxels, count, edits);
+	}
+
+	region_file* rf = open_region(x, y, z, false);
+	if(rf == nullptr) return REGION_LOAD_FAILED;
+
+	uint32_t index = get_region_local_index(x, y, z);
+
+	std::lock_guard<std::mutex> guard(rf->lock);
+
+	region_entry entry = rf->table[index];
+	if(entry.size == 0) return REGION_LOAD_FAILED;
+
+	if(!map_region(rf, entry.offset + entry.size))
+	{
+		std::cerr << "[VOX|ERR] Failed to map region file: " << rf->path << std::endl;
+		return REGION_LOAD_FAILED;
+	}
+
+	//The payload is decoded straight out of the mapping, so the only copy made is the one into the sector itself.
+	const uint8_t* payload = rf->map.get_data() + entry.offset;
+
+	if(hash::crc32(payload, entry.size) != entry.checksum)
+	{
+		std::cerr << "[VOX|ERR] Checksum mismatch for sector (" << x << ", " << y << ", " << z << "), it will be regenerated." << std::endl;
+		return REGION_LOAD_FAILED;
+	}
+
+	if(entry.payload_type == REGION_PAYLOAD_EDITS)
+	{
+		if(!compress::sparse_decode(payload, entry.size, *edits) || edits->size() * sizeof(uint32_t) != entry.raw_size) return REGION_LOAD_FAILED;
+		return REGION_LOAD_EDITS;
+	}
+
+	if(entry.raw_size != count * sizeof(uint32_t)) return REGION_LOAD_FAILED;
+
+	switch(entry.payload_type)
+	{
+		case REGION_PAYLOAD_RAW:
+			if(entry.size != entry.raw_size) return REGION_LOAD_FAILED;
+			std::memcpy(voxels, payload, entry.raw_size);
+			return REGION_LOAD_VOXELS;
+		case REGION_PAYLOAD_RLE:
+			return compress::rle_decode(payload, entry.size, voxels, count) ? REGION_LOAD_VOXELS : REGION_LOAD_FAILED;
+		default:
+			std::cerr << "[VOX|ERR] Unknown payload type " << entry.payload_type << " for sector (" << x << ", " << y << ", " << z << ")." << std::endl;
+			return REGION_LOAD_FAILED;
+	}
+}
+
+void region::prefetch_sector(int64_t x, int64_t y, int64_t z)
+{
+	region_file* rf = open_region(x, y, z, false);
+	if(rf == nullptr) return;
+
+	std::lock_guard<std::mutex> guard(rf->lock);
+
+	region_entry entry = rf->table[get_region_local_index(x, y, z)];
+	if(entry.size == 0) return;
+
+	if(map_region(rf, entry.offset + entry.size)) rf->map.advise_will_need(entry.offset, entry.size);
+}
+
+bool region::sync()
+{
+	flush();
+
+	bool result = true;
+
+	std::lock_guard<std::mutex> guard(region_files_lock);
+	for(auto& it : region_files)
+	{
+		region_file* rf = it.second.get();
+		std::lock_guard<std::mutex> rf_guard(rf->lock);
+
+		if(rf->dirty && !sync_region(rf)) result = false;
+	}
+
+	return result;
+}
+
+void region::queue_save_sector(int64_t x, int64_t y, int64_t z, std::vector<uint32_t> voxels)
+{
+	queue_save_job(x, y, z, std::move(voxels), false);
+}
+
+void region::queue_save_sector_edits(int64_t x, int64_t y, int64_t z, std::vector<uint32_t> edits)
+{
+	queue_save_job(x, y, z, std::move(edits), true);
+}
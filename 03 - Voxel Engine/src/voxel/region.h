@@ -0,0 +1,44 @@
+#ifndef _REGION_H_
+#define _REGION_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//Regions group REGION_SIZE^3 sectors into a single file, indexed by an offset table at the start of the file.
+#define REGION_FACTOR 4
+#define REGION_SIZE (1<<REGION_FACTOR)
+#define REGION_SECTOR_COUNT (REGION_SIZE * REGION_SIZE * REGION_SIZE)
+
+#define REGION_LOAD_FAILED 0
+#define REGION_LOAD_VOXELS 1
+#define REGION_LOAD_EDITS 2
+
+namespace region
+{
+	void deinit();
+
+	//Blocks until every queued save has been written to disk.
+	void flush();
+
+	bool init(const std::string& directory);
+
+	//Safe to call from any thread. Returns REGION_LOAD_FAILED if the sector has never been saved, or if its payload is corrupt.
+	//Sectors saved as full voxel data are written to voxels (REGION_LOAD_VOXELS).
+	//Sectors saved as edits only are written to edits as flattened (voxel code, value) pairs (REGION_LOAD_EDITS).
+	uint8_t load_sector(int64_t x, int64_t y, int64_t z, uint32_t* voxels, size_t count, std::vector<uint32_t>* edits);
+
+	//Asks the OS to start paging in a saved sector's payload, so a later load_sector() doesn't stall on disk.
+	void prefetch_sector(int64_t x, int64_t y, int64_t z);
+
+	//Hands the voxel data to the region writer thread, which compresses and writes it in the background.
+	void queue_save_sector(int64_t x, int64_t y, int64_t z, std::vector<uint32_t> voxels);
+
+	//Same as queue_save_sector(), but only stores edits (as flattened (voxel code, value) pairs) on top of the generated terrain.
+	void queue_save_sector_edits(int64_t x, int64_t y, int64_t z, std::vector<uint32_t> edits);
+
+	//Like flush(), but also waits for the OS to have the written region files on disk.
+	bool sync();
+}
+
+#endif
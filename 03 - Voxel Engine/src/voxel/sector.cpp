@@ -3,6 +3,26 @@
 #define SECTOR_GEN_OPTIMIZE
 #define SECTOR_GEN_OPTIMIZE_LEAP 4
 
+//Uncomment to only save player edits. Sectors are then regenerated from the seed on load, and the edits are applied on top.
+//Saves get smaller, but loads take about three times as long, since generating a sector costs more than decoding a full save of it.
+//#define SECTOR_SAVE_EDITS_ONLY
+
+//Uncomment to lay out voxels in Morton (Z) order, both within bricks and in the copy meshing works on, instead of [x][y][z].
+//Neighbours along any axis then mostly sit within a few cache lines of each other. Saves and voxel codes keep the [x][y][z] order either way.
+//#define SECTOR_LAYOUT_MORTON
+
+//Meshes from a copy of the sector with a one voxel border of air around it, so computing faces needs no bounds checks.
+//Comment out to mesh straight from the voxels instead.
+#define SECTOR_MESH_APRON
+
+//Voxel colors are tinted by noise interpolated over a lattice of (1 << SECTOR_NOISE_FACTOR) voxels, baked into the corners of every quad.
+//Faces are never merged across the lattice, so the interpolation between corners follows the noise.
+#define SECTOR_NOISE_FACTOR 4
+#define SECTOR_NOISE_CELL (1<<SECTOR_NOISE_FACTOR)
+
+//Uncomment to print how much memory the voxels of all loaded sectors take, whenever a sector is compressed, dropped or gets its voxels back.
+//#define DEBUG_SECTOR_MEMORY
+
 #define FACE_LEFT 0
 #define FACE_RIGHT 1
 #define FACE_BOTTOM 2
@@ -13,12 +33,50 @@
 
 #include "../utils/linalg.h"
 
+#include "../utils/compress.h"
+#include "../utils/hash.h"
+
+#include "journal.h"
+#include "material.h"
+#include "region.h"
+
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cstring>
+#include <iostream>
 
 static pipeline_vertex_input pvi;
 
+//Every sector mesh is a range of one of these buffers, so sectors are drawn without binding buffers of their own.
+#define SECTOR_GEOMETRY_BLOCK_SIZE (64 << 20)
+
+//Bytes of sector meshes moved each frame while a sparse geometry block is emptied.
+#define SECTOR_GEOMETRY_MOVE_BUDGET (4 << 20)
+static geometry_pool* geometry = nullptr;
+
 static uint64_t world_seed;
 
+#ifdef DEBUG_SECTOR_MEMORY
+static std::atomic<int64_t> voxel_memory_total(0);
+static std::atomic<int64_t> sector_count(0);
+
+static void report_voxel_memory(const char* action, int64_t x, int64_t y, int64_t z, std::chrono::steady_clock::time_point start)
+{
+	double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	
+	size_t brick_count, reference_count;
+	brick::get_stats(&brick_count, &reference_count);
+	
+	//Bricks are shared, so they're counted once here instead of in voxel_memory_total.
+	int64_t total = voxel_memory_total + (int64_t) (brick_count * sizeof(voxel_brick));
+	
+	std::cout << "[VOX|INF] " << action << " sector (" << x << ", " << y << ", " << z << ") in " << elapsed << " us. Voxels take "
+		<< (total / (1024 * 1024)) << " MB, " << (sector_count > 0 ? total / sector_count / 1024 : 0) << " KB per sector. "
+		<< reference_count << " brick references share " << brick_count << " bricks (" << (brick_count > 0 ? reference_count / brick_count : 0) << "x)." << std::endl;
+}
+#endif
+
 void sector::init(uint64_t seed)
 {
 	pvi.vertex_binding = create_vertex_input_binding(0, 8 * sizeof(float), VK_VERTEX_INPUT_RATE_VERTEX);
@@ -28,6 +86,8 @@ void sector::init(uint64_t seed)
 	pvi.vertex_attribs[2] = create_vertex_input_attribute(0, 2, VK_FORMAT_R32G32_SFLOAT, 6 * sizeof(float));
 	
 	world_seed = seed;
+	
+	geometry = new geometry_pool(pvi.vertex_binding.stride, SECTOR_GEOMETRY_BLOCK_SIZE);
 }
 
 double generate_landscape(double x, double y, double z)
@@ -51,18 +111,211 @@ void get_voxel_from_code(uint32_t code, uint16_t* x, uint16_t* y, uint16_t* z)
 	*z = code & bound;
 }
 
-sector::sector(int64_t x, int64_t y, int64_t z) : x(x), y(y), z(z)
+#ifdef SECTOR_LAYOUT_MORTON
+//Spreads the low SECTOR_FACTOR bits of value out to every third bit.
+static uint32_t spread_bits(uint32_t value)
+{
+	value = (value | (value << 8)) & 0x0300F00F;
+	value = (value | (value << 4)) & 0x030C30C3;
+	value = (value | (value << 2)) & 0x09249249;
+	return value;
+}
+#endif
+
+//Where a voxel sits in memory, as opposed to get_voxel_code() which is what gets saved. Both are the same with the linear layout.
+static uint32_t get_voxel_index(uint16_t x, uint16_t y, uint16_t z)
+{
+#ifdef SECTOR_LAYOUT_MORTON
+	return (spread_bits(x) << 2) | (spread_bits(y) << 1) | spread_bits(z);
+#else
+	return get_voxel_code(x, y, z);
+#endif
+}
+
+static uint32_t get_brick_index(uint16_t x, uint16_t y, uint16_t z)
+{
+	return ((x >> BRICK_FACTOR) * SECTOR_BRICKS + (y >> BRICK_FACTOR)) * SECTOR_BRICKS + (z >> BRICK_FACTOR);
+}
+
+static uint32_t get_brick_local_index(uint16_t x, uint16_t y, uint16_t z)
+{
+	uint16_t bound = BRICK_SIZE - 1;
+	
+#ifdef SECTOR_LAYOUT_MORTON
+	//Morton order doesn't depend on the size of the volume, a brick is laid out just like the start of a sector.
+	return get_voxel_index(x & bound, y & bound, z & bound);
+#else
+	return ((x & bound) * BRICK_SIZE + (y & bound)) * BRICK_SIZE + (z & bound);
+#endif
+}
+
+#ifdef SECTOR_MESH_APRON
+#define APRON_SIZE (SECTOR_SIZE + 2)
+#define APRON_VOLUME (APRON_SIZE * APRON_SIZE * APRON_SIZE)
+
+static uint32_t get_apron_index(uint16_t x, uint16_t y, uint16_t z)
+{
+	return ((x + 1) * APRON_SIZE + (y + 1)) * APRON_SIZE + (z + 1);
+}
+#endif
+
+//Whether the face of a voxel of value, looking at neighbour, can be seen. Air and transparent materials only show the faces of other materials through them.
+static char is_face_visible(const bool* opaque, uint32_t value, uint32_t neighbour)
+{
+	return (char) (neighbour != value && !opaque[neighbour & MATERIAL_ID_MASK]);
+}
+
+//Random tint at a lattice point, in world lattice coordinates.
+static void get_lattice_noise(int64_t x, int64_t y, int64_t z, double out[3])
+{
+	int64_t point[3] = {x, y, z};
+	uint64_t h = hash::hash64(point, sizeof(point));
+	
+	for(uint8_t c = 0; c < 3; c++)
+		out[c] = ((double) ((h >> (c * 8)) & 255) / 255 - 0.5) / 4;
+}
+
+//Smoothly varying tint at a voxel corner, in world voxel coordinates.
+static void get_smooth_noise(int64_t x, int64_t y, int64_t z, float out[3])
+{
+	int64_t cell_x = x >> SECTOR_NOISE_FACTOR;
+	int64_t cell_y = y >> SECTOR_NOISE_FACTOR;
+	int64_t cell_z = z >> SECTOR_NOISE_FACTOR;
+	
+	double corners[8][3];
+	for(uint8_t c = 0; c < 8; c++)
+		get_lattice_noise(cell_x + (c & 1), cell_y + ((c >> 1) & 1), cell_z + ((c >> 2) & 1), corners[c]);
+	
+	double dx = (double) (x & (SECTOR_NOISE_CELL - 1)) / SECTOR_NOISE_CELL;
+	double dy = (double) (y & (SECTOR_NOISE_CELL - 1)) / SECTOR_NOISE_CELL;
+	double dz = (double) (z & (SECTOR_NOISE_CELL - 1)) / SECTOR_NOISE_CELL;
+	
+	for(uint8_t c = 0; c < 3; c++)
+		out[c] = math::interp_linear_3d(corners[0][c], corners[1][c], corners[2][c], corners[3][c], corners[4][c], corners[5][c], corners[6][c], corners[7][c], dx, dy, dz);
+}
+
+//Merged faces starting at start stop at the next lattice plane.
+static uint32_t get_noise_cell_end(float start)
+{
+	return ((uint32_t) start | (SECTOR_NOISE_CELL - 1)) + 1;
+}
+
+//A full brick surrounded by full bricks can't have any faces. Bricks on the sector border always can.
+//Full bricks hold a single value, values has it for each of them.
+static bool is_brick_buried(const uint8_t* occupancy, const uint32_t* values, const bool* opaque, uint16_t bx, uint16_t by, uint16_t bz)
 {
-	voxels = new uint32_t**[SECTOR_SIZE];
-	for(size_t i = 0; i < SECTOR_SIZE; i++)
+	if(bx == 0 || by == 0 || bz == 0 || bx == SECTOR_BRICKS - 1 || by == SECTOR_BRICKS - 1 || bz == SECTOR_BRICKS - 1) return false;
+	
+	uint32_t index = (bx * SECTOR_BRICKS + by) * SECTOR_BRICKS + bz;
+	if(occupancy[index] != BRICK_FULL) return false;
+	
+	int32_t strides[NUM_FACES] = {-SECTOR_BRICKS * SECTOR_BRICKS, SECTOR_BRICKS * SECTOR_BRICKS, -SECTOR_BRICKS, SECTOR_BRICKS, -1, 1};
+	for(uint8_t f = 0; f < NUM_FACES; f++)
 	{
-		voxels[i] = new uint32_t*[SECTOR_SIZE];
-		for(size_t j = 0; j < SECTOR_SIZE; j++)
-			voxels[i][j] = new uint32_t[SECTOR_SIZE];
+		uint32_t neighbour = index + strides[f];
+		if(occupancy[neighbour] != BRICK_FULL || is_face_visible(opaque, values[index], values[neighbour])) return false;
 	}
 	
-	m = new mesh(pvi);
+	return true;
+}
+
+//Voxel codes double as indices into a flat [x][y][z] sector, which is what generation, saving and compression work on.
+static void pack_bricks(const uint32_t* voxels, std::vector<brick_ref>& bricks)
+{
+	bricks.resize(SECTOR_BRICK_COUNT);
+	
+	uint32_t brick_voxels[BRICK_VOLUME];
+	
+	for(uint16_t bx = 0; bx < SECTOR_BRICKS; bx++)
+	for(uint16_t by = 0; by < SECTOR_BRICKS; by++)
+	for(uint16_t bz = 0; bz < SECTOR_BRICKS; bz++)
+	{
+		for(uint16_t i = 0; i < BRICK_SIZE; i++)
+		for(uint16_t j = 0; j < BRICK_SIZE; j++)
+		{
+			const uint32_t* row = voxels + get_voxel_code(bx * BRICK_SIZE + i, by * BRICK_SIZE + j, bz * BRICK_SIZE);
+			for(uint16_t k = 0; k < BRICK_SIZE; k++)
+				brick_voxels[get_brick_local_index(i, j, k)] = row[k];
+		}
+		
+		bricks[(bx * SECTOR_BRICKS + by) * SECTOR_BRICKS + bz] = brick::intern(brick_voxels);
+	}
+}
+
+static void unpack_bricks(const std::vector<brick_ref>& bricks, uint32_t* voxels)
+{
+	for(uint16_t bx = 0; bx < SECTOR_BRICKS; bx++)
+	for(uint16_t by = 0; by < SECTOR_BRICKS; by++)
+	for(uint16_t bz = 0; bz < SECTOR_BRICKS; bz++)
+	{
+		const uint32_t* brick_voxels = bricks[(bx * SECTOR_BRICKS + by) * SECTOR_BRICKS + bz]->voxels;
+		
+		for(uint16_t i = 0; i < BRICK_SIZE; i++)
+		for(uint16_t j = 0; j < BRICK_SIZE; j++)
+		{
+			uint32_t* row = voxels + get_voxel_code(bx * BRICK_SIZE + i, by * BRICK_SIZE + j, bz * BRICK_SIZE);
+			for(uint16_t k = 0; k < BRICK_SIZE; k++)
+				row[k] = brick_voxels[get_brick_local_index(i, j, k)];
+		}
+	}
+}
+
+//Same as unpack_bricks(), but to the in-memory layout (see get_voxel_index()) instead of the [x][y][z] one.
+static void unpack_bricks_to_layout(const std::vector<brick_ref>& bricks, uint32_t* voxels)
+{
+#ifdef SECTOR_LAYOUT_MORTON
+	//Every brick is a contiguous run of the Morton order, laid out the same way inside.
+	for(uint16_t bx = 0; bx < SECTOR_BRICKS; bx++)
+	for(uint16_t by = 0; by < SECTOR_BRICKS; by++)
+	for(uint16_t bz = 0; bz < SECTOR_BRICKS; bz++)
+	{
+		const uint32_t* brick_voxels = bricks[(bx * SECTOR_BRICKS + by) * SECTOR_BRICKS + bz]->voxels;
+		std::memcpy(voxels + get_voxel_index(bx * BRICK_SIZE, by * BRICK_SIZE, bz * BRICK_SIZE), brick_voxels, BRICK_VOLUME * sizeof(uint32_t));
+	}
+#else
+	unpack_bricks(bricks, voxels);
+#endif
+}
+
+#ifdef SECTOR_MESH_APRON
+//Only fills the inside of the apron, the border is left as is.
+static void unpack_bricks_to_apron(const std::vector<brick_ref>& bricks, uint32_t* apron)
+{
+	for(uint16_t bx = 0; bx < SECTOR_BRICKS; bx++)
+	for(uint16_t by = 0; by < SECTOR_BRICKS; by++)
+	for(uint16_t bz = 0; bz < SECTOR_BRICKS; bz++)
+	{
+		const uint32_t* brick_voxels = bricks[(bx * SECTOR_BRICKS + by) * SECTOR_BRICKS + bz]->voxels;
+		
+		for(uint16_t i = 0; i < BRICK_SIZE; i++)
+		for(uint16_t j = 0; j < BRICK_SIZE; j++)
+		{
+			uint32_t* row = apron + get_apron_index(bx * BRICK_SIZE + i, by * BRICK_SIZE + j, bz * BRICK_SIZE);
+			for(uint16_t k = 0; k < BRICK_SIZE; k++)
+				row[k] = brick_voxels[get_brick_local_index(i, j, k)];
+		}
+	}
+}
+#endif
+
+sector::sector(int64_t x, int64_t y, int64_t z) : x(x), y(y), z(z), pyramid(SECTOR_FACTOR)
+{
+	compressed_columns_size = 0;
+	last_access = std::chrono::steady_clock::now();
+	
+	m = new mesh(pvi, geometry);
+	mesh_built = false;
+	edit_version = 0;
+	meshed_version = 0;
+	
 	state = SECTOR_STATE_NEW;
+	modified = false;
+	loaded_full = false;
+	
+#ifdef DEBUG_SECTOR_MEMORY
+	voxel_memory_total += get_voxel_memory();
+	sector_count++;
+#endif
 	
 	math::mat t = math::transform(math::vec3(x, y, z) * SECTOR_SIZE, math::rotation(math::vec3(0, 0, 0)), math::vec3(1, 1, 1));
 	t.get_data(transform_data);
@@ -72,18 +325,53 @@ sector::~sector()
 {
 	delete m;
 	
-	for(size_t i = 0; i < SECTOR_SIZE; i++)
-	{
-		for(size_t j = 0; j < SECTOR_SIZE; j++)
-			delete[] voxels[i][j];
-		delete[] voxels[i];
-	}
-	delete[] voxels;
+#ifdef DEBUG_SECTOR_MEMORY
+	voxel_memory_total -= get_voxel_memory();
+	sector_count--;
+#endif
+}
+
+void sector::begin_draw()
+{
+	geometry->begin_draw();
 }
 
 void sector::build()
-{	
-	state = m->build() ? SECTOR_STATE_DRAWABLE : SECTOR_STATE_EMPTY;
+{
+	//The previous geometry is retired by the pool, frames in flight keep drawing from it until they're done.
+	mesh_built = m->build();
+	state = mesh_built ? SECTOR_STATE_DRAWABLE : SECTOR_STATE_EMPTY;
+	
+	//Edits made after the snapshot this mesh came from get another pass.
+	if(meshed_version != edit_version) state = SECTOR_STATE_GENERATED;
+}
+
+void sector::build_octree(sparse_octree* out)
+{
+	std::lock_guard<std::mutex> guard(voxel_lock);
+	touch_voxels();
+	
+	//Empty space is already known from the pyramid, and bricks know whether they're uniform. Only mixed bricks get looked into.
+	auto classify = [this](uint16_t x, uint16_t y, uint16_t z, uint16_t size) -> uint8_t
+	{
+		uint8_t level = 0;
+		while((1 << level) < size)
+			level++;
+		
+		if(level > 0 && !pyramid.is_occupied(level, x >> level, y >> level, z >> level)) return OCTREE_EMPTY;
+		if(size != BRICK_SIZE) return OCTREE_MIXED;
+		
+		uint8_t occupancy = bricks[get_brick_index(x, y, z)]->occupancy;
+		return occupancy == BRICK_EMPTY ? OCTREE_EMPTY : (occupancy == BRICK_FULL ? OCTREE_FULL : OCTREE_MIXED);
+	};
+	
+	out->build(SECTOR_FACTOR, classify, [this](uint16_t x, uint16_t y, uint16_t z) { return bricks[get_brick_index(x, y, z)]->voxels[get_brick_local_index(x, y, z)] != 0; });
+}
+
+bool sector::is_box_occupied(const uint16_t min[3], const uint16_t max[3])
+{
+	std::lock_guard<std::mutex> guard(voxel_lock);
+	return pyramid.is_box_occupied(min, max, [this](uint16_t x, uint16_t y, uint16_t z) { return get_voxel(x, y, z) != 0; });
 }
 
 bool sector::is_facing(char*** facing, uint16_t x, uint16_t y, uint16_t z, uint8_t face)
@@ -91,12 +379,195 @@ bool sector::is_facing(char*** facing, uint16_t x, uint16_t y, uint16_t z, uint8
 	return (facing[x][y][z] & (1 << face)) == (1 << face);
 }
 
+bool sector::compress_if_idle()
+{
+	if(state != SECTOR_STATE_DRAWABLE && state != SECTOR_STATE_EMPTY) return false;
+	
+	//Whoever holds the lock is using the voxels, so they aren't idle.
+	std::unique_lock<std::mutex> lock(voxel_lock, std::try_to_lock);
+	if(!lock.owns_lock() || bricks.empty()) return false;
+	
+	if(std::chrono::steady_clock::now() - last_access < std::chrono::milliseconds(SECTOR_COMPRESS_IDLE_MS)) return false;
+	
+	//Uniform bricks are shared by every sector using them, so a sector made only of those costs nothing but its brick table.
+	bool uniform = true;
+	for(size_t i = 0; i < bricks.size() && uniform; i++)
+		uniform = bricks[i]->occupancy != BRICK_MIXED;
+	
+	if(uniform) return false;
+	
+#ifdef DEBUG_SECTOR_MEMORY
+	int64_t memory_before = get_voxel_memory();
+	auto start = std::chrono::steady_clock::now();
+#endif
+	
+	std::vector<uint32_t> voxels(SECTOR_VOLUME);
+	unpack_bricks(bricks, voxels.data());
+	
+	std::vector<uint8_t> columns;
+	compress::rle_encode_columns(voxels.data(), SECTOR_SIZE, columns);
+	
+	compressed_voxels.clear();
+	compress::lz_compress(columns.data(), columns.size(), compressed_voxels);
+	compressed_voxels.shrink_to_fit();
+	compressed_columns_size = columns.size();
+	
+	std::vector<brick_ref>().swap(bricks);
+	
+#ifdef DEBUG_SECTOR_MEMORY
+	voxel_memory_total += (int64_t) get_voxel_memory() - memory_before;
+	report_voxel_memory("Compressed", x, y, z, start);
+#endif
+	
+	return true;
+}
+
+//Must be called with voxel_lock held, and not on a dropped sector.
+bool sector::copy_voxels(uint32_t* out)
+{
+	if(!bricks.empty())
+	{
+		unpack_bricks(bricks, out);
+		return true;
+	}
+	
+	std::vector<uint8_t> columns(compressed_columns_size);
+	if(!compress::lz_decompress(compressed_voxels.data(), compressed_voxels.size(), columns.data(), columns.size()) ||
+		!compress::rle_decode_columns(columns.data(), columns.size(), out, SECTOR_SIZE))
+	{
+		std::cerr << "[VOX|ERR] Failed to decompress sector (" << x << ", " << y << ", " << z << ")." << std::endl;
+		std::memset(out, 0, SECTOR_VOLUME * sizeof(uint32_t));
+		return false;
+	}
+	
+	return true;
+}
+
+void sector::defragment_geometry()
+{
+	//The moves are recorded into one command buffer and submitted together.
+	alloc::begin_upload_batch();
+	geometry->defragment(SECTOR_GEOMETRY_MOVE_BUDGET);
+	alloc::submit_upload_batch();
+}
+
+void sector::deinit()
+{
+	delete geometry;
+	geometry = nullptr;
+}
+
 void sector::draw(command_buffer* cmd_buffer)
 {
-	if(state == SECTOR_STATE_DRAWABLE) m->draw(cmd_buffer);
+	//While a remesh is underway, the last built mesh keeps being drawn.
+	if(mesh_built) m->draw(cmd_buffer);
+}
+
+bool sector::drop_voxels()
+{
+	if(state != SECTOR_STATE_DRAWABLE && state != SECTOR_STATE_EMPTY) return false;
+	
+	std::unique_lock<std::mutex> lock(voxel_lock, std::try_to_lock);
+	if(!lock.owns_lock() || is_dropped()) return false;
+	
+#ifdef DEBUG_SECTOR_MEMORY
+	int64_t memory_before = get_voxel_memory();
+	auto start = std::chrono::steady_clock::now();
+#endif
+	
+	std::vector<brick_ref>().swap(bricks);
+	compressed_voxels.clear();
+	compressed_voxels.shrink_to_fit();
+	
+#ifdef DEBUG_SECTOR_MEMORY
+	voxel_memory_total += (int64_t) get_voxel_memory() - memory_before;
+	report_voxel_memory("Dropped voxels of", x, y, z, start);
+#endif
+	
+	return true;
 }
 
 void sector::generate()
+{
+	std::vector<uint32_t> voxels(SECTOR_VOLUME);
+	generate_voxels(voxels.data());
+	
+	{
+		std::lock_guard<std::mutex> guard(voxel_lock);
+		pack_bricks(voxels.data(), bricks);
+		pyramid.build(voxels.data());
+	}
+	
+	state = SECTOR_STATE_GENERATED;
+	modified = true;
+}
+
+void sector::generate_octree(sparse_octree* out)
+{
+#ifdef SECTOR_GEN_OPTIMIZE
+	uint32_t size = SECTOR_SIZE / SECTOR_GEN_OPTIMIZE_LEAP + 1;
+	
+	std::vector<double> gradient_values(size * size * size);
+	for(uint32_t i = 0; i < size; i++)
+	for(uint32_t j = 0; j < size; j++)
+	for(uint32_t k = 0; k < size; k++)
+	{
+		double pos_x = x * SECTOR_SIZE + i * SECTOR_GEN_OPTIMIZE_LEAP;
+		double pos_y = y * SECTOR_SIZE + j * SECTOR_GEN_OPTIMIZE_LEAP;
+		double pos_z = z * SECTOR_SIZE + k * SECTOR_GEN_OPTIMIZE_LEAP;
+		
+		gradient_values[(i * size + j) * size + k] = generate_landscape(pos_x, pos_y, pos_z);
+	}
+	
+	auto gradient = [&](uint32_t i, uint32_t j, uint32_t k) { return gradient_values[(i * size + j) * size + k]; };
+	
+	//Same as in generate_voxels(), a cube is uniform if all the gradient values it's interpolated from agree.
+	auto classify = [&](uint16_t x, uint16_t y, uint16_t z, uint16_t side) -> uint8_t
+	{
+		if(side < SECTOR_GEN_OPTIMIZE_LEAP) return OCTREE_MIXED;
+		
+		double lowest = gradient(x / SECTOR_GEN_OPTIMIZE_LEAP, y / SECTOR_GEN_OPTIMIZE_LEAP, z / SECTOR_GEN_OPTIMIZE_LEAP);
+		double highest = lowest;
+		
+		for(uint32_t i = x / SECTOR_GEN_OPTIMIZE_LEAP; i <= (uint32_t) (x + side) / SECTOR_GEN_OPTIMIZE_LEAP; i++)
+		for(uint32_t j = y / SECTOR_GEN_OPTIMIZE_LEAP; j <= (uint32_t) (y + side) / SECTOR_GEN_OPTIMIZE_LEAP; j++)
+		for(uint32_t k = z / SECTOR_GEN_OPTIMIZE_LEAP; k <= (uint32_t) (z + side) / SECTOR_GEN_OPTIMIZE_LEAP; k++)
+		{
+			lowest = std::min(lowest, gradient(i, j, k));
+			highest = std::max(highest, gradient(i, j, k));
+		}
+		
+		if(lowest >= 0) return OCTREE_EMPTY;
+		if(highest < 0) return OCTREE_FULL;
+		return OCTREE_MIXED;
+	};
+	
+	auto is_solid = [&](uint16_t x, uint16_t y, uint16_t z)
+	{
+		uint32_t i = x / SECTOR_GEN_OPTIMIZE_LEAP;
+		uint32_t j = y / SECTOR_GEN_OPTIMIZE_LEAP;
+		uint32_t k = z / SECTOR_GEN_OPTIMIZE_LEAP;
+		
+		double dx = (double) (x % SECTOR_GEN_OPTIMIZE_LEAP) / SECTOR_GEN_OPTIMIZE_LEAP;
+		double dy = (double) (y % SECTOR_GEN_OPTIMIZE_LEAP) / SECTOR_GEN_OPTIMIZE_LEAP;
+		double dz = (double) (z % SECTOR_GEN_OPTIMIZE_LEAP) / SECTOR_GEN_OPTIMIZE_LEAP;
+		
+		return math::interp_linear_3d(gradient(i, j, k), gradient(i + 1, j, k), gradient(i, j + 1, k), gradient(i + 1, j + 1, k),
+			gradient(i, j, k + 1), gradient(i + 1, j, k + 1), gradient(i, j + 1, k + 1), gradient(i + 1, j + 1, k + 1), dx, dy, dz) < 0;
+	};
+#else
+	auto classify = [](uint16_t x, uint16_t y, uint16_t z, uint16_t side) -> uint8_t { return OCTREE_MIXED; };
+	
+	auto is_solid = [this](uint16_t x, uint16_t y, uint16_t z)
+	{
+		return generate_landscape(this->x * SECTOR_SIZE + x, this->y * SECTOR_SIZE + y, this->z * SECTOR_SIZE + z) < 0;
+	};
+#endif
+	
+	out->build(SECTOR_FACTOR, classify, is_solid);
+}
+
+void sector::generate_voxels(uint32_t* out)
 {
 #ifdef SECTOR_GEN_OPTIMIZE
 	uint32_t size = SECTOR_SIZE / SECTOR_GEN_OPTIMIZE_LEAP + 1;
@@ -132,6 +603,24 @@ void sector::generate()
 		double bab = gradient_values[i + 1][j][k + 1];
 		double abb = gradient_values[i][j + 1][k + 1];
 		double bbb = gradient_values[i + 1][j + 1][k + 1];
+		
+		//Linear interpolation never leaves the range of the corners, so if they all agree the whole cell does.
+		double lowest = std::min({aaa, baa, aba, bba, aab, bab, abb, bbb});
+		double highest = std::max({aaa, baa, aba, bba, aab, bab, abb, bbb});
+		
+		if(lowest >= 0 || highest < 0)
+		{
+			uint32_t value = highest < 0;
+			
+			for(uint32_t x = 0; x < SECTOR_GEN_OPTIMIZE_LEAP; x++)
+			for(uint32_t y = 0; y < SECTOR_GEN_OPTIMIZE_LEAP; y++)
+			{
+				uint32_t* row = out + get_voxel_code(i * SECTOR_GEN_OPTIMIZE_LEAP + x, j * SECTOR_GEN_OPTIMIZE_LEAP + y, k * SECTOR_GEN_OPTIMIZE_LEAP);
+				std::fill(row, row + SECTOR_GEN_OPTIMIZE_LEAP, value);
+			}
+			
+			continue;
+		}
 
 		for(uint32_t x = 0; x < SECTOR_GEN_OPTIMIZE_LEAP; x++)
 		for(uint32_t y = 0; y < SECTOR_GEN_OPTIMIZE_LEAP; y++)
@@ -145,7 +634,7 @@ void sector::generate()
 			double dy = (double) y / SECTOR_GEN_OPTIMIZE_LEAP;
 			double dz = (double) z / SECTOR_GEN_OPTIMIZE_LEAP;
 
-			voxels[ix][iy][iz] = math::interp_linear_3d(aaa, baa, aba, bba, aab, bab, abb, bbb, dx, dy, dz) < 0;
+			out[get_voxel_code(ix, iy, iz)] = math::interp_linear_3d(aaa, baa, aba, bba, aab, bab, abb, bbb, dx, dy, dz) < 0;
 		}
 	}
 	
@@ -165,11 +654,9 @@ void sector::generate()
 		double pos_y = y * SECTOR_SIZE + j;
 		double pos_z = z * SECTOR_SIZE + k;
 
-		voxels[i][j][k] = generate_landscape(pos_x, pos_y, pos_z) < 0;
+		out[get_voxel_code(i, j, k)] = generate_landscape(pos_x, pos_y, pos_z) < 0;
 	}
 #endif
-
-	state = SECTOR_STATE_GENERATED;
 }
 
 void sector::get_pos(int64_t* pos_x, int64_t* pos_y, int64_t* pos_z)
@@ -184,10 +671,55 @@ uint8_t sector::get_state() const
 	return state;
 }
 
-void sector::load_mesh()
+uint32_t sector::get_voxel(uint16_t x, uint16_t y, uint16_t z)
 {
-	uint16_t bound = SECTOR_SIZE - 1;
+	touch_voxels();
+	return bricks[get_brick_index(x, y, z)]->voxels[get_brick_local_index(x, y, z)];
+}
+
+size_t sector::get_voxel_memory() const
+{
+	return bricks.capacity() * sizeof(brick_ref) + compressed_voxels.capacity();
+}
+
+bool sector::is_dropped() const
+{
+	return bricks.empty() && compressed_voxels.empty();
+}
+
+bool sector::load()
+{
+	std::vector<uint32_t> voxels(SECTOR_VOLUME);
+	std::vector<uint32_t> saved_edits;
+	
+	switch(read_voxels(voxels.data(), &saved_edits))
+	{
+		case REGION_LOAD_VOXELS:
+			loaded_full = true;
+			break;
+		case REGION_LOAD_EDITS:
+			for(size_t i = 0; i + 1 < saved_edits.size(); i += 2)
+				edits[saved_edits[i]] = saved_edits[i + 1];
+			
+			loaded_full = false;
+			break;
+		default:
+			return false;
+	}
+	
+	{
+		std::lock_guard<std::mutex> guard(voxel_lock);
+		pack_bricks(voxels.data(), bricks);
+		pyramid.build(voxels.data());
+	}
 	
+	state = SECTOR_STATE_GENERATED;
+	modified = false;
+	return true;
+}
+
+void sector::load_mesh()
+{
 	char*** facing = new char**[SECTOR_SIZE];
 	for(uint16_t i = 0; i < SECTOR_SIZE; i++)
 	{
@@ -196,23 +728,131 @@ void sector::load_mesh()
 			facing[i][j] = new char[SECTOR_SIZE];
 	}
 	
-	for(uint32_t i = 0; i < SECTOR_SIZE; i++)
-	for(uint32_t j = 0; j < SECTOR_SIZE; j++)
-	for(uint32_t k = 0; k < SECTOR_SIZE; k++)
+	std::vector<brick_ref> snapshot;
 	{
-		facing[i][j][k] = 0;
+		std::lock_guard<std::mutex> guard(voxel_lock);
+		touch_voxels();
 		
-		if(voxels[i][j][k] != 0)
+		//Only the brick references are copied. Edits from here on replace bricks in the sector, never the ones in the snapshot.
+		snapshot = bricks;
+		meshed_version = edit_version.load();
+	}
+	
+#ifdef SECTOR_MESH_APRON
+	//Neighbouring sectors aren't looked at, so the border is air and faces on the sector's sides are always kept, same as without the apron.
+	std::vector<uint32_t> apron(APRON_VOLUME, 0);
+	unpack_bricks_to_apron(snapshot, apron.data());
+	
+	int32_t stride_x = APRON_SIZE * APRON_SIZE;
+	int32_t stride_y = APRON_SIZE;
+#else
+	std::vector<uint32_t> voxels(SECTOR_VOLUME);
+	unpack_bricks_to_layout(snapshot, voxels.data());
+	
+	uint16_t bound = SECTOR_SIZE - 1;
+#endif
+	
+	uint8_t occupancy[SECTOR_BRICK_COUNT];
+	uint32_t values[SECTOR_BRICK_COUNT];
+	for(uint32_t i = 0; i < SECTOR_BRICK_COUNT; i++)
+	{
+		occupancy[i] = snapshot[i]->occupancy;
+		values[i] = snapshot[i]->voxels[0];
+	}
+	
+	const material_table& materials = material::get_table();
+	
+	snapshot.clear();
+	
+	//Set for every brick holding at least one face. The merging below steps over the others.
+	bool brick_faces[SECTOR_BRICK_COUNT];
+	
+	for(uint16_t bx = 0; bx < SECTOR_BRICKS; bx++)
+	for(uint16_t by = 0; by < SECTOR_BRICKS; by++)
+	for(uint16_t bz = 0; bz < SECTOR_BRICKS; bz++)
+	{
+		uint32_t brick_index = (bx * SECTOR_BRICKS + by) * SECTOR_BRICKS + bz;
+		
+		uint16_t start_x = bx * BRICK_SIZE;
+		uint16_t start_y = by * BRICK_SIZE;
+		uint16_t start_z = bz * BRICK_SIZE;
+		
+		uint16_t end_x = start_x + BRICK_SIZE - 1;
+		uint16_t end_y = start_y + BRICK_SIZE - 1;
+		
+		bool skip = occupancy[brick_index] == BRICK_EMPTY || is_brick_buried(occupancy, values, materials.opaque, bx, by, bz);
+		
+		brick_faces[brick_index] = false;
+		
+		for(uint16_t i = start_x; i <= end_x; i++)
+		for(uint16_t j = start_y; j <= end_y; j++)
 		{
-			facing[i][j][k] |= ((char) (i == 0 || voxels[i - 1][j][k] == 0)) << FACE_LEFT;
-			facing[i][j][k] |= ((char) (i == bound || voxels[i + 1][j][k] == 0)) << FACE_RIGHT;
-			facing[i][j][k] |= ((char) (j == 0 || voxels[i][j - 1][k] == 0)) << FACE_BOTTOM;
-			facing[i][j][k] |= ((char) (j == bound || voxels[i][j + 1][k] == 0)) << FACE_TOP;
-			facing[i][j][k] |= ((char) (k == 0 || voxels[i][j][k - 1] == 0)) << FACE_FRONT;
-			facing[i][j][k] |= ((char) (k == bound || voxels[i][j][k + 1] == 0)) << FACE_BACK;
+			if(skip)
+			{
+				std::memset(facing[i][j] + start_z, 0, BRICK_SIZE);
+				continue;
+			}
+			
+#ifdef SECTOR_MESH_APRON
+			const uint32_t* row = apron.data() + get_apron_index(i, j, start_z);
+			char row_faces = 0;
+			
+			for(uint16_t k = 0; k < BRICK_SIZE; k++)
+			{
+				const uint32_t* voxel = row + k;
+				
+				char faces = is_face_visible(materials.opaque, voxel[0], voxel[-stride_x]) << FACE_LEFT;
+				faces |= is_face_visible(materials.opaque, voxel[0], voxel[stride_x]) << FACE_RIGHT;
+				faces |= is_face_visible(materials.opaque, voxel[0], voxel[-stride_y]) << FACE_BOTTOM;
+				faces |= is_face_visible(materials.opaque, voxel[0], voxel[stride_y]) << FACE_TOP;
+				faces |= is_face_visible(materials.opaque, voxel[0], voxel[-1]) << FACE_FRONT;
+				faces |= is_face_visible(materials.opaque, voxel[0], voxel[1]) << FACE_BACK;
+				
+				facing[i][j][start_z + k] = faces & -((char) (voxel[0] != 0));
+				row_faces |= facing[i][j][start_z + k];
+			}
+			
+			if(row_faces != 0) brick_faces[brick_index] = true;
+#else
+			//Inside a full brick, only the voxels on its outside can have faces.
+			bool full = occupancy[brick_index] == BRICK_FULL;
+			uint16_t end_z = start_z + BRICK_SIZE - 1;
+			
+			for(uint16_t k = start_z; k <= end_z; k++)
+			{
+				facing[i][j][k] = 0;
+				
+				if(full && i != start_x && i != end_x && j != start_y && j != end_y && k != start_z && k != end_z) continue;
+				
+				uint32_t value = voxels[get_voxel_index(i, j, k)];
+				
+				if(value != 0)
+				{
+					facing[i][j][k] |= ((char) (i == 0 || is_face_visible(materials.opaque, value, voxels[get_voxel_index(i - 1, j, k)]))) << FACE_LEFT;
+					facing[i][j][k] |= ((char) (i == bound || is_face_visible(materials.opaque, value, voxels[get_voxel_index(i + 1, j, k)]))) << FACE_RIGHT;
+					facing[i][j][k] |= ((char) (j == 0 || is_face_visible(materials.opaque, value, voxels[get_voxel_index(i, j - 1, k)]))) << FACE_BOTTOM;
+					facing[i][j][k] |= ((char) (j == bound || is_face_visible(materials.opaque, value, voxels[get_voxel_index(i, j + 1, k)]))) << FACE_TOP;
+					facing[i][j][k] |= ((char) (k == 0 || is_face_visible(materials.opaque, value, voxels[get_voxel_index(i, j, k - 1)]))) << FACE_FRONT;
+					facing[i][j][k] |= ((char) (k == bound || is_face_visible(materials.opaque, value, voxels[get_voxel_index(i, j, k + 1)]))) << FACE_BACK;
+					
+					if(facing[i][j][k] != 0) brick_faces[brick_index] = true;
+				}
+			}
+#endif
 		}
 	}
 	
+	
+	//Faces are only merged with faces of the same material, so every quad gets a single color.
+	auto get_material = [&](uint32_t x, uint32_t y, uint32_t z)
+	{
+#ifdef SECTOR_MESH_APRON
+		return apron[get_apron_index(x, y, z)];
+#else
+		return voxels[get_voxel_index(x, y, z)];
+#endif
+	};
+	
 	uint32_t index_count = 0;
 	
 	bool should_loop = true;
@@ -224,6 +864,13 @@ void sector::load_mesh()
 		for(float j = 0; j < SECTOR_SIZE; j++)
 		for(float k = 0; k < SECTOR_SIZE; k++)
 		{
+			//Faces only ever get cleared from here on, so a brick without any never gets one.
+			if(((uint32_t) k & (BRICK_SIZE - 1)) == 0 && !brick_faces[get_brick_index(i, j, k)])
+			{
+				k += BRICK_SIZE - 1;
+				continue;
+			}
+			
 			bool left_facing = is_facing(facing, i, j, k, FACE_LEFT);
 			bool right_facing = is_facing(facing, i, j, k, FACE_RIGHT);
 			bool bottom_facing = is_facing(facing, i, j, k, FACE_BOTTOM);
@@ -231,6 +878,19 @@ void sector::load_mesh()
 			bool front_facing = is_facing(facing, i, j, k, FACE_FRONT);
 			bool back_facing = is_facing(facing, i, j, k, FACE_BACK);
 			
+			if(!left_facing && !right_facing && !bottom_facing && !top_facing && !front_facing && !back_facing) continue;
+			
+			uint32_t voxel_material = get_material(i, j, k);
+			const float* color = materials.color[voxel_material & MATERIAL_ID_MASK];
+			
+			auto add_corner = [&](float corner_x, float corner_y, float corner_z, float face, float side)
+			{
+				float noise[3];
+				get_smooth_noise(x * SECTOR_SIZE + (int64_t) corner_x, y * SECTOR_SIZE + (int64_t) corner_y, z * SECTOR_SIZE + (int64_t) corner_z, noise);
+				
+				m->add_vertex({corner_x, corner_y, corner_z,   color[0] + noise[0], color[1] + noise[1], color[2] + noise[2],   face, side});
+			};
+			
 			if(left_facing)
 			{
 				should_loop = true;
@@ -241,18 +901,18 @@ void sector::load_mesh()
 				float end_y = start_y + 1;
 				float end_z = start_z + 1;
 				
-				for(uint32_t a = end_y; a < SECTOR_SIZE; a++)
+				for(uint32_t a = end_y; a < get_noise_cell_end(start_y); a++)
 				{
-					if(!is_facing(facing, i, a, k, FACE_LEFT)) break;
+					if(!is_facing(facing, i, a, k, FACE_LEFT) || get_material(i, a, k) != voxel_material) break;
 					end_y++;
 				}
 				
-				for(uint32_t b = end_z; b < SECTOR_SIZE; b++)
+				for(uint32_t b = end_z; b < get_noise_cell_end(start_z); b++)
 				{
 					bool should_break = false;
 					for(uint32_t a = j; a < end_y; a++)
 					{
-						if(!is_facing(facing, i, a, b, FACE_LEFT))
+						if(!is_facing(facing, i, a, b, FACE_LEFT) || get_material(i, a, b) != voxel_material)
 						{
 							should_break = true;
 							break;
@@ -262,10 +922,10 @@ void sector::load_mesh()
 					end_z++;
 				}
 				
-				m->add_vertex({i, start_y, start_z,   1  , 0.5, 0.5,   FACE_LEFT, 0});
-				m->add_vertex({i, end_y  , start_z,   1  , 0.5, 0.5,   FACE_LEFT, 0});
-				m->add_vertex({i, end_y  , end_z  ,   1  , 0.5, 0.5,   FACE_LEFT, 1});
-				m->add_vertex({i, start_y, end_z  ,   1  , 0.5, 0.5,   FACE_LEFT, 1});
+				add_corner(i, start_y, start_z, FACE_LEFT, 0);
+				add_corner(i, end_y  , start_z, FACE_LEFT, 0);
+				add_corner(i, end_y  , end_z  , FACE_LEFT, 1);
+				add_corner(i, start_y, end_z  , FACE_LEFT, 1);
 				
 				m->add_indices({0 + index_count, 2 + index_count, 1 + index_count, 0 + index_count, 3 + index_count, 2 + index_count});
 				index_count += 4;
@@ -287,18 +947,18 @@ void sector::load_mesh()
 				float end_y = start_y + 1;
 				float end_z = start_z + 1;
 				
-				for(uint32_t a = end_y; a < SECTOR_SIZE; a++)
+				for(uint32_t a = end_y; a < get_noise_cell_end(start_y); a++)
 				{
-					if(!is_facing(facing, i, a, k, FACE_RIGHT)) break;
+					if(!is_facing(facing, i, a, k, FACE_RIGHT) || get_material(i, a, k) != voxel_material) break;
 					end_y++;
 				}
 				
-				for(uint32_t b = end_z; b < SECTOR_SIZE; b++)
+				for(uint32_t b = end_z; b < get_noise_cell_end(start_z); b++)
 				{
 					bool should_break = false;
 					for(uint32_t a = j; a < end_y; a++)
 					{
-						if(!is_facing(facing, i, a, b, FACE_RIGHT))
+						if(!is_facing(facing, i, a, b, FACE_RIGHT) || get_material(i, a, b) != voxel_material)
 						{
 							should_break = true;
 							break;
@@ -308,10 +968,10 @@ void sector::load_mesh()
 					end_z++;
 				}
 				
-				m->add_vertex({i + 1, start_y, start_z,   0.5, 1  , 0.5,   FACE_RIGHT, 0});
-				m->add_vertex({i + 1, end_y  , start_z,   0.5, 1  , 0.5,   FACE_RIGHT, 0});
-				m->add_vertex({i + 1, end_y  , end_z  ,   0.5, 1  , 0.5,   FACE_RIGHT, 1});
-				m->add_vertex({i + 1, start_y, end_z  ,   0.5, 1  , 0.5,   FACE_RIGHT, 1});
+				add_corner(i + 1, start_y, start_z, FACE_RIGHT, 0);
+				add_corner(i + 1, end_y  , start_z, FACE_RIGHT, 0);
+				add_corner(i + 1, end_y  , end_z  , FACE_RIGHT, 1);
+				add_corner(i + 1, start_y, end_z  , FACE_RIGHT, 1);
 				
 				m->add_indices({0 + index_count, 1 + index_count, 2 + index_count, 0 + index_count, 2 + index_count, 3 + index_count});
 				index_count += 4;
@@ -333,18 +993,18 @@ void sector::load_mesh()
 				float end_x = start_x + 1;
 				float end_z = start_z + 1;
 				
-				for(uint32_t a = end_x; a < SECTOR_SIZE; a++)
+				for(uint32_t a = end_x; a < get_noise_cell_end(start_x); a++)
 				{
-					if(!is_facing(facing, a, j, k, FACE_BOTTOM)) break;
+					if(!is_facing(facing, a, j, k, FACE_BOTTOM) || get_material(a, j, k) != voxel_material) break;
 					end_x++;
 				}
 				
-				for(uint32_t b = end_z; b < SECTOR_SIZE; b++)
+				for(uint32_t b = end_z; b < get_noise_cell_end(start_z); b++)
 				{
 					bool should_break = false;
 					for(uint32_t a = i; a < end_x; a++)
 					{
-						if(!is_facing(facing, a, j, b, FACE_BOTTOM))
+						if(!is_facing(facing, a, j, b, FACE_BOTTOM) || get_material(a, j, b) != voxel_material)
 						{
 							should_break = true;
 							break;
@@ -354,10 +1014,10 @@ void sector::load_mesh()
 					end_z++;
 				}
 				
-				m->add_vertex({start_x, j, start_z,   0.5, 0.5, 1  ,   FACE_BOTTOM, 0});
-				m->add_vertex({end_x  , j, start_z,   0.5, 0.5, 1  ,   FACE_BOTTOM, 0});
-				m->add_vertex({end_x  , j, end_z  ,   0.5, 0.5, 1  ,   FACE_BOTTOM, 1});
-				m->add_vertex({start_x, j, end_z  ,   0.5, 0.5, 1  ,   FACE_BOTTOM, 1});
+				add_corner(start_x, j, start_z, FACE_BOTTOM, 0);
+				add_corner(end_x  , j, start_z, FACE_BOTTOM, 0);
+				add_corner(end_x  , j, end_z  , FACE_BOTTOM, 1);
+				add_corner(start_x, j, end_z  , FACE_BOTTOM, 1);
 				
 				m->add_indices({0 + index_count, 1 + index_count, 2 + index_count, 0 + index_count, 2 + index_count, 3 + index_count});
 				index_count += 4;
@@ -379,18 +1039,18 @@ void sector::load_mesh()
 				float end_x = start_x + 1;
 				float end_z = start_z + 1;
 				
-				for(uint32_t a = end_x; a < SECTOR_SIZE; a++)
+				for(uint32_t a = end_x; a < get_noise_cell_end(start_x); a++)
 				{
-					if(!is_facing(facing, a, j, k, FACE_TOP)) break;
+					if(!is_facing(facing, a, j, k, FACE_TOP) || get_material(a, j, k) != voxel_material) break;
 					end_x++;
 				}
 				
-				for(uint32_t b = end_z; b < SECTOR_SIZE; b++)
+				for(uint32_t b = end_z; b < get_noise_cell_end(start_z); b++)
 				{
 					bool should_break = false;
 					for(uint32_t a = i; a < end_x; a++)
 					{
-						if(!is_facing(facing, a, j, b, FACE_TOP))
+						if(!is_facing(facing, a, j, b, FACE_TOP) || get_material(a, j, b) != voxel_material)
 						{
 							should_break = true;
 							break;
@@ -400,10 +1060,10 @@ void sector::load_mesh()
 					end_z++;
 				}
 				
-				m->add_vertex({start_x, j + 1, start_z,   1  , 1  , 0.5,   FACE_TOP, 0});
-				m->add_vertex({end_x  , j + 1, start_z,   1  , 1  , 0.5,   FACE_TOP, 0});
-				m->add_vertex({end_x  , j + 1, end_z  ,   1  , 1  , 0.5,   FACE_TOP, 1});
-				m->add_vertex({start_x, j + 1, end_z  ,   1  , 1  , 0.5,   FACE_TOP, 1});
+				add_corner(start_x, j + 1, start_z, FACE_TOP, 0);
+				add_corner(end_x  , j + 1, start_z, FACE_TOP, 0);
+				add_corner(end_x  , j + 1, end_z  , FACE_TOP, 1);
+				add_corner(start_x, j + 1, end_z  , FACE_TOP, 1);
 				
 				m->add_indices({0 + index_count, 2 + index_count, 1 + index_count, 0 + index_count, 3 + index_count, 2 + index_count});
 				index_count += 4;
@@ -425,18 +1085,18 @@ void sector::load_mesh()
 				float end_x = start_x + 1;
 				float end_y = start_y + 1;
 				
-				for(uint32_t a = end_x; a < SECTOR_SIZE; a++)
+				for(uint32_t a = end_x; a < get_noise_cell_end(start_x); a++)
 				{
-					if(!is_facing(facing, a, j, k, FACE_FRONT)) break;
+					if(!is_facing(facing, a, j, k, FACE_FRONT) || get_material(a, j, k) != voxel_material) break;
 					end_x++;
 				}
 				
-				for(uint32_t b = end_y; b < SECTOR_SIZE; b++)
+				for(uint32_t b = end_y; b < get_noise_cell_end(start_y); b++)
 				{
 					bool should_break = false;
 					for(uint32_t a = i; a < end_x; a++)
 					{
-						if(!is_facing(facing, a, b, k, FACE_FRONT))
+						if(!is_facing(facing, a, b, k, FACE_FRONT) || get_material(a, b, k) != voxel_material)
 						{
 							should_break = true;
 							break;
@@ -446,10 +1106,10 @@ void sector::load_mesh()
 					end_y++;
 				}
 				
-				m->add_vertex({start_x, start_y, k,   1  , 0.5, 1  ,   FACE_FRONT, 0});
-				m->add_vertex({end_x  , start_y, k,   1  , 0.5, 1  ,   FACE_FRONT, 0});
-				m->add_vertex({end_x  , end_y  , k,   1  , 0.5, 1  ,   FACE_FRONT, 1});
-				m->add_vertex({start_x, end_y  , k,   1  , 0.5, 1  ,   FACE_FRONT, 1});
+				add_corner(start_x, start_y, k, FACE_FRONT, 0);
+				add_corner(end_x  , start_y, k, FACE_FRONT, 0);
+				add_corner(end_x  , end_y  , k, FACE_FRONT, 1);
+				add_corner(start_x, end_y  , k, FACE_FRONT, 1);
 				
 				m->add_indices({0 + index_count, 2 + index_count, 1 + index_count, 0 + index_count, 3 + index_count, 2 + index_count});
 				index_count += 4;
@@ -471,18 +1131,18 @@ void sector::load_mesh()
 				float end_x = start_x + 1;
 				float end_y = start_y + 1;
 				
-				for(uint32_t a = end_x; a < SECTOR_SIZE; a++)
+				for(uint32_t a = end_x; a < get_noise_cell_end(start_x); a++)
 				{
-					if(!is_facing(facing, a, j, k, FACE_BACK)) break;
+					if(!is_facing(facing, a, j, k, FACE_BACK) || get_material(a, j, k) != voxel_material) break;
 					end_x++;
 				}
 				
-				for(uint32_t b = end_y; b < SECTOR_SIZE; b++)
+				for(uint32_t b = end_y; b < get_noise_cell_end(start_y); b++)
 				{
 					bool should_break = false;
 					for(uint32_t a = i; a < end_x; a++)
 					{
-						if(!is_facing(facing, a, b, k, FACE_BACK))
+						if(!is_facing(facing, a, b, k, FACE_BACK) || get_material(a, b, k) != voxel_material)
 						{
 							should_break = true;
 							break;
@@ -492,10 +1152,10 @@ void sector::load_mesh()
 					end_y++;
 				}
 				
-				m->add_vertex({start_x, start_y, k + 1,   0.5, 1  , 1  ,   FACE_BACK, 0});
-				m->add_vertex({end_x  , start_y, k + 1,   0.5, 1  , 1  ,   FACE_BACK, 0});
-				m->add_vertex({end_x  , end_y  , k + 1,   0.5, 1  , 1  ,   FACE_BACK, 1});
-				m->add_vertex({start_x, end_y  , k + 1,   0.5, 1  , 1  ,   FACE_BACK, 1});
+				add_corner(start_x, start_y, k + 1, FACE_BACK, 0);
+				add_corner(end_x  , start_y, k + 1, FACE_BACK, 0);
+				add_corner(end_x  , end_y  , k + 1, FACE_BACK, 1);
+				add_corner(start_x, end_y  , k + 1, FACE_BACK, 1);
 				
 				m->add_indices({0 + index_count, 1 + index_count, 2 + index_count, 0 + index_count, 2 + index_count, 3 + index_count});
 				index_count += 4;
@@ -522,19 +1182,173 @@ void sector::load_mesh()
 	state = SECTOR_STATE_MESH_LOADED;
 }
 
-void sector::set(uint16_t x, uint16_t y, uint16_t z, uint32_t value, bool reload)
+uint8_t sector::read_voxels(uint32_t* out, std::vector<uint32_t>* saved_edits)
+{
+	uint8_t result = region::load_sector(x, y, z, out, SECTOR_VOLUME, saved_edits);
+	
+	if(result == REGION_LOAD_EDITS)
+	{
+		//The checksum only catches accidental damage, so voxel codes are checked before anything is written with them. load() relies on this too.
+		for(size_t i = 0; i + 1 < saved_edits->size(); i += 2)
+		{
+			if((*saved_edits)[i] >= SECTOR_VOLUME)
+			{
+				std::cerr << "[VOX|ERR] Sector (" << x << ", " << y << ", " << z << ") has a saved edit outside of it, at " << (*saved_edits)[i] << "." << std::endl;
+				return REGION_LOAD_FAILED;
+			}
+		}
+		
+		generate_voxels(out);
+		
+		for(size_t i = 0; i + 1 < saved_edits->size(); i += 2)
+			out[(*saved_edits)[i]] = (*saved_edits)[i + 1];
+	}
+	
+	return result;
+}
+
+//Whatever is on disk (or the generator) plus every edit since the sector was loaded is exactly what was dropped.
+//Edits that already made it to disk are just applied twice.
+void sector::restore_voxels()
+{
+	std::vector<uint32_t> voxels(SECTOR_VOLUME);
+	std::vector<uint32_t> saved_edits;
+	
+	if(read_voxels(voxels.data(), &saved_edits) == REGION_LOAD_FAILED) generate_voxels(voxels.data());
+	
+	for(auto& it : edits)
+		voxels[it.first] = it.second;
+	
+	pack_bricks(voxels.data(), bricks);
+}
+
+bool sector::raycast(const float origin[3], const float direction[3], float max_distance, uint16_t hit[3], float* distance)
+{
+	std::lock_guard<std::mutex> guard(voxel_lock);
+	return pyramid.raycast(origin, direction, max_distance, [this](uint16_t x, uint16_t y, uint16_t z) { return get_voxel(x, y, z) != 0; }, hit, distance);
+}
+
+void sector::save()
+{
+	if(!modified || state == SECTOR_STATE_NEW) return;
+	
+#ifdef SECTOR_SAVE_EDITS_ONLY
+	//A sector that came from a full save has no record of its older edits, so it has to keep being saved in full.
+	if(!loaded_full)
+	{
+		if(edits.size() > 0)
+		{
+			std::vector<std::pair<uint32_t, uint32_t> > sorted(edits.begin(), edits.end());
+			std::sort(sorted.begin(), sorted.end());
+			
+			std::vector<uint32_t> data;
+			data.reserve(sorted.size() * 2);
+			for(size_t i = 0; i < sorted.size(); i++)
+			{
+				data.push_back(sorted[i].first);
+				data.push_back(sorted[i].second);
+			}
+			
+			region::queue_save_sector_edits(x, y, z, std::move(data));
+		}
+		
+		modified = false;
+		return;
+	}
+#endif
+	
+	//Compressed sectors are decompressed straight into the save, there's no point inflating them just to be unloaded.
+	std::vector<uint32_t> data(SECTOR_VOLUME);
+	{
+		std::lock_guard<std::mutex> guard(voxel_lock);
+		
+		//Without edits, a dropped sector is just what the generator (or an older save) gives back, so it isn't worth restoring only to save it.
+		if(is_dropped())
+		{
+			if(edits.empty())
+			{
+				modified = false;
+				return;
+			}
+			
+			touch_voxels();
+		}
+		
+		if(!copy_voxels(data.data())) return;
+	}
+	
+	region::queue_save_sector(x, y, z, std::move(data));
+	modified = false;
+}
+
+void sector::set(uint16_t x, uint16_t y, uint16_t z, uint32_t value)
 {
 	if(x >= SECTOR_SIZE || y >= SECTOR_SIZE || z >= SECTOR_SIZE) return;
 	
-	voxels[x][y][z] = value;
-	if(reload)
+	if(value >= material::get_count())
+	{
+		std::cerr << "[VOX|WRN] Ignoring voxel set to unknown material " << value << "." << std::endl;
+		return;
+	}
+	
+	uint32_t code = get_voxel_code(x, y, z);
+	
+	{
+		std::lock_guard<std::mutex> guard(voxel_lock);
+		touch_voxels();
+		
+		//Copy on write, a mesh snapshot may still be reading the old brick.
+		brick_ref& b = bricks[get_brick_index(x, y, z)];
+		
+		voxel_brick copy = *b;
+		copy.voxels[get_brick_local_index(x, y, z)] = value;
+		b = brick::intern(copy.voxels);
+		
+		//The 2x2x2 cell at the bottom of the pyramid never straddles two bricks.
+		bool cell_occupied = false;
+		for(uint16_t c = 0; c < 8; c++)
+			cell_occupied |= copy.voxels[get_brick_local_index((x & ~1) | (c >> 2), (y & ~1) | ((c >> 1) & 1), (z & ~1) | (c & 1))] != 0;
+		
+		pyramid.set_cell(x, y, z, cell_occupied);
+		
+		edits[code] = value;
+		modified = true;
+		edit_version++;
+	}
+	
+	journal::log_edit(this->x, this->y, this->z, code, value);
+	
+	//If a remesh is already underway from an older snapshot, build() queues another one.
+	if(state == SECTOR_STATE_DRAWABLE || state == SECTOR_STATE_EMPTY) state = SECTOR_STATE_GENERATED;
+}
+
+void sector::touch_voxels()
+{
+	last_access = std::chrono::steady_clock::now();
+	if(!bricks.empty()) return;
+	
+#ifdef DEBUG_SECTOR_MEMORY
+	int64_t memory_before = get_voxel_memory();
+	bool was_dropped = is_dropped();
+	auto start = std::chrono::steady_clock::now();
+#endif
+	
+	if(is_dropped())
 	{
-		vkDeviceWaitIdle(get_device());
-		load_mesh();
-		build();
+		restore_voxels();
 	}
 	else
 	{
-		state = SECTOR_STATE_GENERATED;
+		std::vector<uint32_t> voxels(SECTOR_VOLUME);
+		copy_voxels(voxels.data());
+		pack_bricks(voxels.data(), bricks);
+		
+		compressed_voxels.clear();
+		compressed_voxels.shrink_to_fit();
 	}
-}
\ No newline at end of file
+	
+#ifdef DEBUG_SECTOR_MEMORY
+	voxel_memory_total += (int64_t) get_voxel_memory() - memory_before;
+	report_voxel_memory(was_dropped ? "Restored voxels of" : "Decompressed", x, y, z, start);
+#endif
+}
@@ -5,8 +5,28 @@
 
 #include "../utils/mesh.h"
 
+#include "brick.h"
+#include "occupancy.h"
+#include "octree.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
 #define SECTOR_FACTOR 6
 #define SECTOR_SIZE (1<<SECTOR_FACTOR)
+#define SECTOR_VOLUME (SECTOR_SIZE * SECTOR_SIZE * SECTOR_SIZE)
+
+#define SECTOR_BRICKS (SECTOR_SIZE / BRICK_SIZE)
+#define SECTOR_BRICK_COUNT (SECTOR_BRICKS * SECTOR_BRICKS * SECTOR_BRICKS)
+
+//Bump whenever generate() changes its output, since edit-only saves are applied on top of freshly generated terrain.
+#define SECTOR_GENERATOR_VERSION 1
+
+//Drawable sectors whose voxels haven't been touched for this long are kept compressed until they're needed again.
+#define SECTOR_COMPRESS_IDLE_MS 2000
 
 #define SECTOR_STATE_NEW 0
 #define SECTOR_STATE_GENERATED 1
@@ -20,28 +40,106 @@ class sector
 		sector(int64_t x, int64_t y, int64_t z);
 		~sector();
 		
+		//Call before drawing sectors into a command buffer, so their geometry gets bound again.
+		static void begin_draw();
+		
 		void build();
 		
+		//Far-field form of the voxels, from the bricks (so with any edits).
+		void build_octree(sparse_octree* out);
+		
+		//Called by the background pass. Returns whether the voxels were compressed.
+		bool compress_if_idle();
+		
+		//Moves a few sector meshes out of sparse geometry blocks, and gives emptied blocks back. Called once a frame, outside of an upload batch.
+		static void defragment_geometry();
+		
+		//Frees the geometry of every sector's mesh. Call after every sector is deleted.
+		static void deinit();
+		
 		void draw(command_buffer* cmd_buffer);
 		
+		//Frees the voxels (compressed or not) of a meshed sector, keeping only its mesh. They're restored from disk or the generator when needed again.
+		bool drop_voxels();
+		
+		//Whether any voxel in the box (sector coordinates, bounds inclusive) is non-zero. Empty space is ruled out through the occupancy pyramid, only voxels on the edges of the box are looked at.
+		bool is_box_occupied(const uint16_t min[3], const uint16_t max[3]);
+		
 		bool is_facing(char*** facing, uint16_t x, uint16_t y, uint16_t z, uint8_t face);
 		
 		void generate();
+		
+		//Builds the far-field form of the sector straight from the generator, without generating its voxels. Doesn't know about edits.
+		void generate_octree(sparse_octree* out);
+		
 		void get_pos(int64_t* pos_x, int64_t* pos_y, int64_t* pos_z);
 
 		uint8_t get_state() const;
 		
 		static void init(uint64_t seed);
 
+		bool load();
 		void load_mesh();
 		
-		void set(uint16_t x, uint16_t y, uint16_t z, uint32_t value, bool reload);
+		//In sector coordinates, one unit per voxel. Skips over empty space through the occupancy pyramid.
+		bool raycast(const float origin[3], const float direction[3], float max_distance, uint16_t hit[3], float* distance);
+		
+		void save();
+		
+		//Never waits for meshing. The sector is remeshed in the background, from a snapshot taken after the edit.
+		void set(uint16_t x, uint16_t y, uint16_t z, uint32_t value);
 	private:
 		int64_t x, y, z;
 		uint8_t state;
 		
+		//Set whenever the voxels differ from what's on disk.
+		bool modified;
+		
+		//Every voxel changed through set(), keyed by voxel code. Empty if the sector was loaded from a full save.
+		std::unordered_map<uint32_t, uint32_t> edits;
+		bool loaded_full;
+		
 		mesh* m;
-		uint32_t*** voxels;
+		bool mesh_built;
+		
+		//Bumped by every set(). A mesh built from a snapshot older than the latest edit gets queued again.
+		std::atomic<uint32_t> edit_version;
+		std::atomic<uint32_t> meshed_version;
+		
+		//[brick x][brick y][brick z], each brick being an interned, immutable voxel_brick. A snapshot is just a copy of this table.
+		//Empty while the sector is compressed, in which case the voxels live in compressed_voxels instead.
+		//If compressed_voxels is empty as well, the voxels were dropped.
+		std::vector<brick_ref> bricks;
+		
+		//Kept up to date by set(), and kept around while the voxels are compressed or dropped.
+		occupancy_pyramid pyramid;
+		
+		//Y-column RLE, then LZ. compressed_columns_size is the size of the RLE stream.
+		std::vector<uint8_t> compressed_voxels;
+		size_t compressed_columns_size;
+		
+		std::chrono::steady_clock::time_point last_access;
+		
+		//Guards bricks, pyramid and compressed_voxels. Meshing only holds it long enough to take a snapshot.
+		std::mutex voxel_lock;
+		
+		bool copy_voxels(uint32_t* out);
+		
+		void generate_voxels(uint32_t* out);
+		
+		//Must be called with voxel_lock held.
+		uint32_t get_voxel(uint16_t x, uint16_t y, uint16_t z);
+		
+		size_t get_voxel_memory() const;
+		
+		bool is_dropped() const;
+		
+		//Returns a REGION_LOAD_* code. Sectors saved as edits only are generated, with the edits applied on top. Edits outside the sector fail the load.
+		uint8_t read_voxels(uint32_t* out, std::vector<uint32_t>* saved_edits);
+		void restore_voxels();
+		
+		//Must be called with voxel_lock held, before touching bricks. Decompresses or restores them if needed.
+		void touch_voxels();
 		
 		float transform_data[16];
 };
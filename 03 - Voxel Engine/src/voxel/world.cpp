@@ -2,14 +2,29 @@
 
 #include "../ref.h"
 
+#include <chrono>
 #include <cmath>
+#include <fstream>
+#include <iostream>
 #include <vector>
 
+#include "journal.h"
+#include "material.h"
+#include "region.h"
 #include "sector.h"
+#include "../utils/alloc.h"
 #include "../utils/linalg.h"
 
 #define SECTOR_LAYER_SIZE 3
 
+#define WORLD_SAVE_DIRECTORY "../saves/world/"
+#define WORLD_INFO_FILE WORLD_SAVE_DIRECTORY "world.dat"
+#define WORLD_INFO_MAGIC 0x44575856
+#define WORLD_INFO_VERSION 2
+
+//Uncomment to print how long sectors take to come from disk versus the generator.
+//#define DEBUG_WORLD_TIMING
+
 struct sector_draw_data
 {
     float transform_data[16];
@@ -30,21 +45,98 @@ static int voxel_timer = 0;
 
 static int current_process;
 
+//Sectors further than this from the camera (in sectors, on any axis) only keep their mesh, see sector::drop_voxels().
+#define SECTOR_EDIT_RADIUS 1
+
+//Minimum distance the camera has to move between two sector updates before we consider it travelling.
+#define PREFETCH_MIN_TRAVEL 0.01
+
+static math::vec last_camera_pos;
+static int64_t camera_sector[3];
+static int prefetch_dir[3];
+static int64_t last_camera_sector[3];
+static int last_prefetch_dir[3];
+
+#ifdef DEBUG_WORLD_TIMING
+static double timing_generate_total = 0, timing_load_total = 0;
+static uint32_t timing_generate_count = 0, timing_load_count = 0;
+static uint32_t timing_last_reported = 0;
+#endif
+
+struct world_info
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t seed;
+    uint32_t generator_version;
+    uint32_t reserved;
+};
+
+//Version 1 files stop after the seed.
+#define WORLD_INFO_V1_SIZE (2 * sizeof(uint32_t) + sizeof(uint64_t))
+
+static bool load_world_info(uint64_t* seed)
+{
+    std::ifstream in(WORLD_INFO_FILE, std::ios::binary);
+    if(!in.is_open()) return false;
+
+    world_info info{};
+    in.read((char*) &info, WORLD_INFO_V1_SIZE);
+    if(in.good() && info.version == WORLD_INFO_VERSION) in.read((char*) &info.generator_version, sizeof(info) - WORLD_INFO_V1_SIZE);
+    else info.generator_version = 1;
+
+    if(!in.good() || info.magic != WORLD_INFO_MAGIC || info.version > WORLD_INFO_VERSION)
+    {
+        std::cerr << "[VOX|ERR] " << WORLD_INFO_FILE << " is corrupt or from an incompatible version." << std::endl;
+        return false;
+    }
+
+    if(info.generator_version != SECTOR_GENERATOR_VERSION)
+    {
+        std::cerr << "[VOX|WRN] World was saved with generator version " << info.generator_version << ", but the current one is " << SECTOR_GENERATOR_VERSION << "." << std::endl;
+        std::cerr << "\tSectors saved as edits only will be applied on top of terrain that may look different." << std::endl;
+    }
+
+    *seed = info.seed;
+    return true;
+}
+
+static void save_world_info(uint64_t seed)
+{
+    world_info info{};
+    info.magic = WORLD_INFO_MAGIC;
+    info.version = WORLD_INFO_VERSION;
+    info.seed = seed;
+    info.generator_version = SECTOR_GENERATOR_VERSION;
+
+    std::ofstream out(WORLD_INFO_FILE, std::ios::binary);
+    out.write((const char*) &info, sizeof(info));
+    if(!out.good()) std::cerr << "[VOX|ERR] Failed to write " << WORLD_INFO_FILE << "." << std::endl;
+}
+
 void world::deinit()
 {
     for(size_t i = 0; i < sectors.size(); i++)
     {
         for(size_t j = 0; j < sectors[i].size(); j++)
         {
+            sectors[i][j]->save();
             delete sectors[i][j];
         }
         sectors[i].clear();
     }
     sectors.clear();
+
+    sector::deinit();
+
+    journal::deinit();
+    region::deinit();
 }
 
 void world::draw(command_buffer* cmd_buffer, pipeline* pl)
 {
+    sector::begin_draw();
+
     for(int i = 0; i < sectors.size(); i++)
     {
         for(int j = 0; j < sectors[i].size(); j++)
@@ -72,7 +164,22 @@ size_t world::get_sector_index(int64_t x, int64_t y, int64_t z)
 
 void world::init()
 {
-    sector::init(glfwGetTime() * 1000000000);
+    material::init();
+    region::init(WORLD_SAVE_DIRECTORY);
+    journal::init(WORLD_SAVE_DIRECTORY);
+
+    uint64_t seed;
+    if(load_world_info(&seed))
+    {
+        INFO_LOG("Loaded world from " << WORLD_SAVE_DIRECTORY << ".");
+    }
+    else
+    {
+        seed = glfwGetTime() * 1000000000;
+        save_world_info(seed);
+    }
+
+    sector::init(seed);
     default_rot = math::rotation(math::vec3(0, 0, 0));
 
     sectors.resize(1);
@@ -115,7 +222,7 @@ void world::update_input(GLFWwindow* window, bool window_focused, uint32_t* voxe
                     break;
             }
             
-            sectors[0][voxel_selection_data[2]]->set(voxel_x, voxel_y, voxel_z, 0, true);
+            sectors[0][voxel_selection_data[2]]->set(voxel_x, voxel_y, voxel_z, MATERIAL_AIR);
         }
         
         if(glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_2))
@@ -137,17 +244,52 @@ void world::update_input(GLFWwindow* window, bool window_focused, uint32_t* voxe
                     break;
             }
             
-            sectors[0][voxel_selection_data[2]]->set(voxel_x, voxel_y, voxel_z, 1, true);
+            sectors[0][voxel_selection_data[2]]->set(voxel_x, voxel_y, voxel_z, MATERIAL_GRASS);
         }
         
         voxel_timer = 25;
     }
 }
 
+//Hints the OS to page in the saved sectors just beyond the loaded area, on the side the camera is heading towards.
+static void prefetch_sectors_ahead()
+{
+    bool changed = false;
+    for(int a = 0; a < 3; a++)
+    {
+        if(camera_sector[a] != last_camera_sector[a] || prefetch_dir[a] != last_prefetch_dir[a]) changed = true;
+        last_camera_sector[a] = camera_sector[a];
+        last_prefetch_dir[a] = prefetch_dir[a];
+    }
+
+    if(!changed) return;
+
+    for(int a = 0; a < 3; a++)
+    {
+        if(prefetch_dir[a] == 0) continue;
+
+        int b = (a + 1) % 3;
+        int c = (a + 2) % 3;
+
+        for(int64_t u = -SECTOR_LAYER_SIZE; u <= SECTOR_LAYER_SIZE; u++)
+        for(int64_t v = -SECTOR_LAYER_SIZE; v <= SECTOR_LAYER_SIZE; v++)
+        {
+            int64_t pos[3];
+            pos[a] = camera_sector[a] + prefetch_dir[a] * (SECTOR_LAYER_SIZE + 1);
+            pos[b] = camera_sector[b] + u;
+            pos[c] = camera_sector[c] + v;
+
+            region::prefetch_sector(pos[0], pos[1], pos[2]);
+        }
+    }
+}
+
 void world::update_sectors_alt_thread()
 {
     if(current_process == WORLD_PROCESS_GENERATIING_SECTORS)
     {
+        prefetch_sectors_ahead();
+
         for(int i = 0; i < sectors[0].size(); i++)
         {
             if(sectors[0][i]->get_state() == SECTOR_STATE_NEW)
@@ -155,7 +297,25 @@ void world::update_sectors_alt_thread()
                 //std::string log = "Generating: " + std::to_string(i + 1) + "/" + std::to_string(sectors[0].size());
                 //INFO_LOG(log);
                 
-                sectors[0][i]->generate();
+#ifdef DEBUG_WORLD_TIMING
+                auto start = std::chrono::steady_clock::now();
+                bool loaded = sectors[0][i]->load();
+                if(!loaded) sectors[0][i]->generate();
+                double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+                if(loaded)
+                {
+                    timing_load_total += elapsed;
+                    timing_load_count++;
+                }
+                else
+                {
+                    timing_generate_total += elapsed;
+                    timing_generate_count++;
+                }
+#else
+                if(!sectors[0][i]->load()) sectors[0][i]->generate();
+#endif
             }
 
             if(sectors[0][i]->get_state() == SECTOR_STATE_GENERATED)
@@ -167,6 +327,27 @@ void world::update_sectors_alt_thread()
             }
         }
 
+        for(int i = 0; i < sectors[0].size(); i++)
+        {
+            int64_t sx, sy, sz;
+            sectors[0][i]->get_pos(&sx, &sy, &sz);
+
+            if(std::abs(sx - camera_sector[0]) > SECTOR_EDIT_RADIUS || std::abs(sy - camera_sector[1]) > SECTOR_EDIT_RADIUS || std::abs(sz - camera_sector[2]) > SECTOR_EDIT_RADIUS)
+                sectors[0][i]->drop_voxels();
+            else
+                sectors[0][i]->compress_if_idle();
+        }
+
+#ifdef DEBUG_WORLD_TIMING
+        if(timing_load_count + timing_generate_count != timing_last_reported)
+        {
+            timing_last_reported = timing_load_count + timing_generate_count;
+            INFO_LOG("Sectors loaded from disk: " << timing_load_count << " (avg " << (timing_load_count > 0 ? timing_load_total / timing_load_count : 0) << " us, "
+                << (timing_load_total > 0 ? timing_load_count / (timing_load_total / 1000000) : 0) << " sectors/s), generated: "
+                << timing_generate_count << " (avg " << (timing_generate_count > 0 ? timing_generate_total / timing_generate_count : 0) << " us).");
+        }
+#endif
+
         current_process = WORLD_PROCESS_MANAGING_SECTORS;
     }
 }
@@ -181,6 +362,17 @@ void world::update_sectors_main_thread(camera3d* camera)
         int64_t cam_pos_y = std::floor(camera_pos[1] / SECTOR_SIZE);
         int64_t cam_pos_z = std::floor(camera_pos[2] / SECTOR_SIZE);
 
+        camera_sector[0] = cam_pos_x;
+        camera_sector[1] = cam_pos_y;
+        camera_sector[2] = cam_pos_z;
+
+        for(int a = 0; a < 3; a++)
+        {
+            double travel = last_camera_pos.size() == 3 ? camera_pos[a] - last_camera_pos[a] : 0;
+            prefetch_dir[a] = travel > PREFETCH_MIN_TRAVEL ? 1 : (travel < -PREFETCH_MIN_TRAVEL ? -1 : 0);
+        }
+        last_camera_pos = camera_pos;
+
         for(int64_t i = cam_pos_x - SECTOR_LAYER_SIZE; i <= cam_pos_x + SECTOR_LAYER_SIZE; i++)
         for(int64_t j = cam_pos_y - SECTOR_LAYER_SIZE; j <= cam_pos_y + SECTOR_LAYER_SIZE; j++)
         for(int64_t k = cam_pos_z - SECTOR_LAYER_SIZE; k <= cam_pos_z + SECTOR_LAYER_SIZE; k++)
@@ -217,6 +409,7 @@ void world::update_sectors_main_thread(camera3d* camera)
             {
                 vkDeviceWaitIdle(get_device());
                 
+                sectors[i][j]->save();
                 delete sectors[i][j];
                 sectors[i].erase(sectors[i].begin() + j);
                 sectors_pc_data[i].erase(sectors_pc_data[i].begin() + j);
@@ -235,6 +428,9 @@ void world::update_sectors_main_thread(camera3d* camera)
 
     if(current_process == WORLD_PROCESS_GENERATIING_SECTORS)
     {
+        //Every mesh built this update is uploaded in a single submission.
+        alloc::begin_upload_batch();
+
         for(int i = 0; i < sectors[0].size(); i++)
         {
             if(sectors[0][i]->get_state() == SECTOR_STATE_MESH_LOADED)
@@ -245,5 +441,10 @@ void world::update_sectors_main_thread(camera3d* camera)
                 sectors[0][i]->build();
             }
         }
+
+        alloc::submit_upload_batch();
     }
+
+    //Sparse geometry blocks are emptied a little every frame, so memory doesn't grow over long sessions.
+    sector::defragment_geometry();
 }
\ No newline at end of file